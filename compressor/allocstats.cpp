@@ -0,0 +1,184 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "allocstats.h"
+
+#include <atomic>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#include <errno.h>
+
+static std::atomic<qint64> s_current{0};
+static std::atomic<qint64> s_peak{0};
+static std::atomic<qint64> s_count{0};
+
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static void allocated(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    //Usable size is known for every block, so free doesn't need own header.
+    const qint64 size = static_cast<qint64>(malloc_usable_size(ptr));
+    const qint64 now = s_current.fetch_add(size, std::memory_order_relaxed) + size;
+    qint64 peak = s_peak.load(std::memory_order_relaxed);
+    while (now > peak && !s_peak.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+    { }
+
+    s_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void released(void *ptr)
+{
+    if (ptr)
+        s_current.fetch_sub(static_cast<qint64>(malloc_usable_size(ptr)),
+                            std::memory_order_relaxed);
+}
+
+//Replaces malloc family of libc for whole process (operator new uses malloc).
+extern "C"
+{
+void* malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    allocated(ptr);
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    allocated(ptr);
+    return ptr;
+}
+
+void* realloc(void *ptr, size_t size)
+{
+    const qint64 oldSize = ptr ? static_cast<qint64>(malloc_usable_size(ptr)) : 0;
+    void *result = __libc_realloc(ptr, size);
+    //Zero size frees block.
+    if (result || (ptr && size == 0))
+        s_current.fetch_sub(oldSize, std::memory_order_relaxed);
+
+    if (result)
+    {
+        //Resize in place isn't new allocation.
+        allocated(result);
+        if (result == ptr)
+            s_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    return result;
+}
+
+void free(void *ptr)
+{
+    released(ptr);
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+    allocated(ptr);
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    void *result = memalign(alignment, size);
+    if (!result && size != 0)
+        return ENOMEM;
+
+    *ptr = result;
+    return 0;
+}
+
+void* valloc(size_t size)
+{
+    return memalign(4096, size);
+}
+}
+
+bool AllocStats::isAvailable() noexcept
+{
+    return true;
+}
+
+qint64 AllocStats::current() noexcept
+{
+    return s_current.load(std::memory_order_relaxed);
+}
+
+qint64 AllocStats::peak() noexcept
+{
+    return s_peak.load(std::memory_order_relaxed);
+}
+
+void AllocStats::resetPeak() noexcept
+{
+    s_peak.store(s_current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+qint64 AllocStats::count() noexcept
+{
+    return s_count.load(std::memory_order_relaxed);
+}
+#else
+bool AllocStats::isAvailable() noexcept
+{
+    return false;
+}
+
+qint64 AllocStats::current() noexcept
+{
+    return 0;
+}
+
+qint64 AllocStats::peak() noexcept
+{
+    return 0;
+}
+
+void AllocStats::resetPeak() noexcept
+{
+
+}
+
+qint64 AllocStats::count() noexcept
+{
+    return 0;
+}
+#endif
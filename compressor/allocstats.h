@@ -0,0 +1,40 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <QtGlobal>
+
+//Heap of process counted by replaced malloc family (glibc only, memory of other threads too).
+class AllocStats
+{
+public:
+    //False if allocations are not counted (not glibc), then all values are 0.
+    static bool isAvailable() noexcept;
+
+    //Bytes allocated now and peak since last resetPeak.
+    static qint64 current() noexcept;
+    static qint64 peak() noexcept;
+    static void resetPeak() noexcept;
+
+    //Count of allocations (malloc, calloc, realloc to new block, aligned allocations).
+    static qint64 count() noexcept;
+};
+
+#endif // ALLOCSTATS_H
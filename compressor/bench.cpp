@@ -0,0 +1,239 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "allocstats.h"
+#include "zcompressor.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+struct BenchResult
+{
+    const char *format;
+    int level;
+    double ratio;
+    double defSpeed;
+    double infSpeed;
+    //Peak heap of compressor and decompressor in KiB.
+    double defMemory;
+    double infMemory;
+    //Times of chunk write and read.
+    double writeP50;
+    double writeP99;
+    double readP50;
+    double readP99;
+};
+
+//Peak heap since mark in KiB (0 if allocations are not counted).
+static double peakMemory(qint64 mark)
+{
+    return (AllocStats::peak() - mark) / 1024.0;
+}
+
+//Percentile of sorted times in microseconds.
+static double percentile(const QVector<qint64> &times, int percent)
+{
+    if (times.isEmpty())
+        return 0;
+
+    return times.at((times.size() - 1) * percent / 100) / 1000.0;
+}
+
+static double speed(qint64 size, qint64 nsecs)
+{
+    return nsecs > 0 ? size / (1024.0 * 1024.0) / (nsecs / 1e9) : 0;
+}
+
+//Compresses and decompresses sample by device interface, every write or read of chunk is timed,
+//decompressed data is compared with sample. Buffers of benchmark are allocated before heap mark,
+//so peak heap is memory of compressor.
+static bool run(const QByteArray &sample, int chunk, ZCompressor::CompressFormat format,
+                int level, BenchResult &result)
+{
+    QVector<qint64> times;
+    times.reserve(sample.size() / chunk + 2);
+    QVector<qint64> readTimes;
+    readTimes.reserve(sample.size() / chunk + 2);
+
+    //Stored blocks and headers of blocked gzip fit in reserve.
+    QByteArray compressed;
+    compressed.reserve(static_cast<int>(compressBound(static_cast<uLong>(sample.size()))
+                                        + sample.size() / 1024 + 1024));
+    QBuffer out(&compressed);
+    out.open(QIODevice::WriteOnly);
+    QByteArray data(chunk, Qt::Uninitialized);
+
+    AllocStats::resetPeak();
+    qint64 mark = AllocStats::current();
+    ZCompressor cmprs(&out);
+    cmprs.setCompressFormat(format);
+    cmprs.setCompressLevel(level);
+    if (!cmprs.open(QIODevice::WriteOnly))
+        return false;
+
+    QElapsedTimer total;
+    QElapsedTimer timer;
+    total.start();
+    for (int i = 0; i < sample.size(); i += chunk)
+    {
+        const int size = qMin(chunk, sample.size() - i);
+        timer.start();
+        if (cmprs.write(sample.constData() + i, size) != size)
+            return false;
+        times.append(timer.nsecsElapsed());
+    }
+
+    //End of stream is last chunk.
+    timer.start();
+    cmprs.close();
+    times.append(timer.nsecsElapsed());
+    const qint64 defTime = total.nsecsElapsed();
+    result.defMemory = peakMemory(mark);
+    if (cmprs.state() != Z_STREAM_END)
+        return false;
+
+    QBuffer in(&compressed);
+    in.open(QIODevice::ReadOnly);
+
+    AllocStats::resetPeak();
+    mark = AllocStats::current();
+    ZCompressor dcmprs(&in);
+    dcmprs.setCompressFormat(format);
+    if (!dcmprs.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = 0;
+    qint64 avail;
+    total.start();
+    do
+    {
+        timer.start();
+        avail = dcmprs.read(data.data(), chunk);
+        readTimes.append(timer.nsecsElapsed());
+
+        //Decompressed data must be the sample.
+        if (avail > sample.size() - size
+                || memcmp(data.constData(), sample.constData() + size,
+                          static_cast<size_t>(qMax<qint64>(avail, 0))) != 0)
+            return false;
+
+        size += qMax<qint64>(avail, 0);
+    }
+    while (avail > 0);
+    const qint64 infTime = total.nsecsElapsed();
+    result.infMemory = peakMemory(mark);
+    if (size != sample.size() || dcmprs.state() != Z_STREAM_END)
+        return false;
+
+    std::sort(times.begin(), times.end());
+    std::sort(readTimes.begin(), readTimes.end());
+    result.level = level;
+    result.ratio = compressed.isEmpty() ? 0 : sample.size() / static_cast<double>(compressed.size());
+    result.defSpeed = speed(sample.size(), defTime);
+    result.infSpeed = speed(sample.size(), infTime);
+    result.writeP50 = percentile(times, 50);
+    result.writeP99 = percentile(times, 99);
+    result.readP50 = percentile(readTimes, 50);
+    result.readP99 = percentile(readTimes, 99);
+
+    return true;
+}
+
+int bench(const QString &fileName, int chunk, bool json)
+{
+    QFile file(fileName);
+    if (chunk <= 0 || !file.open(QIODevice::ReadOnly))
+    {
+        cerr << "Can't open sample file!" << endl;
+        return 1;
+    }
+
+    const QByteArray sample = file.readAll();
+    const struct
+    {
+        const char *name;
+        ZCompressor::CompressFormat format;
+    } formats[] = {{"Zlib", ZCompressor::ZlibFormat}, {"Gzip", ZCompressor::GzipFormat},
+                   {"RawDeflate", ZCompressor::RawDeflateFormat},
+                   {"BlockedGzip", ZCompressor::BlockedGzipFormat}};
+
+    QVector<BenchResult> results;
+    for (const auto &format : formats)
+    {
+        for (int level = 0; level <= 9; ++level)
+        {
+            BenchResult result;
+            result.format = format.name;
+            if (!run(sample, chunk, format.format, level, result))
+            {
+                cerr << "Failed " << format.name << " level " << level << "!" << endl;
+                return 1;
+            }
+
+            results.append(result);
+        }
+    }
+
+    if (json)
+    {
+        QJsonArray array;
+        for (const auto &result : results)
+        {
+            QJsonObject object;
+            object.insert(QStringLiteral("format"), QString::fromLatin1(result.format));
+            object.insert(QStringLiteral("level"), result.level);
+            object.insert(QStringLiteral("ratio"), result.ratio);
+            object.insert(QStringLiteral("compressMBs"), result.defSpeed);
+            object.insert(QStringLiteral("decompressMBs"), result.infSpeed);
+            object.insert(QStringLiteral("compressHeapKiB"), result.defMemory);
+            object.insert(QStringLiteral("decompressHeapKiB"), result.infMemory);
+            object.insert(QStringLiteral("writeP50us"), result.writeP50);
+            object.insert(QStringLiteral("writeP99us"), result.writeP99);
+            object.insert(QStringLiteral("readP50us"), result.readP50);
+            object.insert(QStringLiteral("readP99us"), result.readP99);
+            array.append(object);
+        }
+
+        cout << QJsonDocument(array).toJson().constData();
+    }
+    else
+    {
+        printf("%-12s %5s %7s %10s %12s %9s %9s %9s %9s %9s %9s\n", "format", "level", "ratio",
+               "comp MB/s", "decomp MB/s", "comp KiB", "dec KiB", "w p50 us", "w p99 us",
+               "r p50 us", "r p99 us");
+        for (const auto &result : results)
+            printf("%-12s %5d %7.3f %10.1f %12.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                   result.format, result.level, result.ratio, result.defSpeed, result.infSpeed,
+                   result.defMemory, result.infMemory, result.writeP50, result.writeP99,
+                   result.readP50, result.readP99);
+    }
+
+    return 0;
+}
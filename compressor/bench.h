@@ -0,0 +1,28 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+class QString;
+
+//Compresses and decompresses sample file in memory with every format and level by chunks, prints
+//ratio, speed, peak heap of compressor and decompressor and time per written and read chunk as
+//table or JSON. Decompressed data is compared with sample. Returns 0 on success.
+int bench(const QString &fileName, int chunk, bool json);
+
+#endif // BENCH_H
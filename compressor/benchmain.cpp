@@ -0,0 +1,56 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "bench.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QString>
+#include <iostream>
+
+using namespace std;
+
+//Benchmark is separate program, its malloc replacement (allocstats) isn't linked in compressor.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("compressor-bench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks every format and level with "
+                                                    "sample file in memory."));
+    parser.addPositionalArgument(QStringLiteral("sample"), QStringLiteral("Sample file."));
+    QCommandLineOption chunkOpt(QStringList{QStringLiteral("chunk")},
+                                QStringLiteral("Size of chunk written and read by benchmark."),
+                                QStringLiteral("bytes"), QStringLiteral("16384"));
+    parser.addOption(chunkOpt);
+    QCommandLineOption jsonOpt(QStringList{QStringLiteral("json")},
+                               QStringLiteral("Print benchmark as JSON."));
+    parser.addOption(jsonOpt);
+    parser.addHelpOption();
+    parser.process(app);
+
+    const auto args = parser.positionalArguments();
+    if (args.isEmpty())
+    {
+        cerr << "Too few arguments!" << endl;
+        return 1;
+    }
+
+    return bench(args.at(0), parser.value(chunkOpt).toInt(), parser.isSet(jsonOpt));
+}
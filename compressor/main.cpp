@@ -14,19 +14,329 @@
 */
 
 #include "zcompressor.h"
+#include "zipwriter.h"
+#include "tarwriter.h"
 
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
 #include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QStringList>
+#include <cstdio>
 #include <iostream>
 
+using namespace std;
+
+//Compression settings of command line.
+struct Settings
+{
+    bool decmp;
+    int lvl;
+    ZCompressor::CompressFormat frmt;
+    ZCompressor::Options options;
+    int threads;
+    //Previous version of data for delta compression.
+    QString reference;
+};
+
+//Opens file, "-" is stdin or stdout.
+static bool openFile(QFile &file, const QString &name, QIODevice::OpenMode mode)
+{
+    if (name == QStringLiteral("-"))
+        return file.open(mode & QIODevice::ReadOnly ? stdin : stdout, mode);
+
+    file.setFileName(name);
+    return file.open(mode);
+}
+
+//Writes index of blocked gzip file to file with .gzi suffix (as bgzip -i).
+static int writeIndex(const QString &name)
+{
+    QFile file(name);
+    QFile index(name + QStringLiteral(".gzi"));
+    BlockedGzipIndex blocks;
+    if (!file.open(QIODevice::ReadOnly) || !blocks.build(&file)
+            || !index.open(QIODevice::WriteOnly) || !blocks.save(&index))
+    {
+        cerr << "Can't write index " << qPrintable(index.fileName()) << "!" << endl;
+        return Z_ERRNO;
+    }
+
+    return Z_OK;
+}
+
+//Compresses or decompresses one file.
+static int process(const QString &srcName, const QString &destName, const Settings &settings)
+{
+    QFile src;
+    QFile dest;
+    if (!openFile(src, srcName, QIODevice::ReadOnly)
+            || !openFile(dest, destName, QIODevice::WriteOnly))
+    {
+        //Files closes in destructor if necessary.
+        cerr << "Can't open " << qPrintable(srcName) << " or " << qPrintable(destName) << "!"
+             << endl;
+        return Z_ERRNO;
+    }
+
+    if (!settings.reference.isEmpty())
+    {
+        QFile reference(settings.reference);
+        if (!reference.open(QIODevice::ReadOnly))
+        {
+            cerr << "Can't open " << qPrintable(settings.reference) << "!" << endl;
+            return Z_ERRNO;
+        }
+
+        return settings.decmp ? ZCompressor::infDelta(&src, &dest, &reference)
+                              : ZCompressor::defDelta(&src, &dest, &reference, settings.lvl);
+    }
+
+    //Single stream is compressed by blocks and decompressed by speculative chunks in several
+    //threads (stdin is decompressed with reader and writer threads).
+    if (settings.decmp && settings.threads > 1)
+        return ZCompressor::infParallel(&src, &dest, settings.frmt, settings.threads);
+    else if (settings.decmp)
+        return ZCompressor::inf(&src, &dest, settings.frmt, settings.options);
+
+    int ret;
+    if (settings.threads > 1 && !(settings.options & ZCompressor::RsyncableOption))
+        ret = ZCompressor::defParallel(&src, &dest, settings.lvl, settings.frmt, settings.threads);
+    else
+        ret = ZCompressor::def(&src, &dest, settings.lvl, settings.frmt, settings.options);
+
+    //Blocked gzip file gets index of blocks for random access.
+    if (ret == Z_OK && settings.frmt == ZCompressor::BlockedGzipFormat
+            && destName != QStringLiteral("-"))
+    {
+        dest.close();
+        ret = writeIndex(destName);
+    }
+
+    return ret;
+}
+
+static QString suffix(ZCompressor::CompressFormat frmt)
+{
+    switch (frmt)
+    {
+    case ZCompressor::ZlibFormat:
+        return QStringLiteral(".zz");
+    case ZCompressor::RawDeflateFormat:
+        return QStringLiteral(".deflate");
+    default:
+        return QStringLiteral(".gz");
+    }
+}
+
+class BatchTask : public QRunnable
+{
+public:
+    BatchTask(const QString &name, const Settings &settings, QMutex &mutex, int &failed)
+        : m_name(name), m_settings(settings), m_mutex(mutex), m_failed(failed)
+    {
+
+    }
+
+    void run() override
+    {
+        //Decompressed file is named without suffix of format.
+        const QString sfx = suffix(m_settings.frmt);
+        QString dest = m_name + sfx;
+        if (m_settings.decmp)
+        {
+            if (!m_name.endsWith(sfx))
+            {
+                fail("unknown suffix");
+                return;
+            }
+
+            dest = m_name.left(m_name.size() - sfx.size());
+        }
+
+        if (process(m_name, dest, m_settings) != Z_OK)
+            fail("failed");
+    }
+
+private:
+    void fail(const char *reason)
+    {
+        QMutexLocker locker(&m_mutex);
+        cerr << qPrintable(m_name) << ": " << reason << endl;
+        ++m_failed;
+    }
+
+    QString m_name;
+    Settings m_settings;
+    QMutex &m_mutex;
+    int &m_failed;
+};
+
+//Compresses or decompresses files concurrently, files are processed in one thread each.
+static int batch(const QStringList &names, const Settings &settings)
+{
+    Settings fileSettings = settings;
+    fileSettings.threads = 1;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(settings.threads);
+    QMutex mutex;
+    int failed = 0;
+    for (const auto &name : names)
+        pool.start(new BatchTask(name, fileSettings, mutex, failed));
+
+    pool.waitForDone();
+    return failed == 0 ? 0 : 1;
+}
+
+//Names in archive are relative.
+static QString entryName(const QString &name)
+{
+    QString entry = QDir::cleanPath(QDir::fromNativeSeparators(name));
+    while (entry.startsWith(QLatin1Char('/')) || entry.startsWith(QStringLiteral("../")))
+        entry.remove(0, entry.indexOf(QLatin1Char('/')) + 1);
+
+    return entry;
+}
+
+//Writes files to new zip archive.
+static int zip(const QString &archiveName, const QStringList &names)
+{
+    QFile archive(archiveName);
+    if (!archive.open(QIODevice::WriteOnly))
+    {
+        cerr << "Can't open " << qPrintable(archiveName) << "!" << endl;
+        return 1;
+    }
+
+    ZipWriter writer(&archive);
+    for (const auto &name : names)
+    {
+        //Files of directory are compressed in several threads.
+        if (QFileInfo(name).isDir())
+        {
+            if (!writer.addDirectory(name))
+            {
+                cerr << "Can't write " << qPrintable(name) << "!" << endl;
+                return 1;
+            }
+
+            continue;
+        }
+
+        QFile file(name);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            cerr << "Can't open " << qPrintable(name) << "!" << endl;
+            return 1;
+        }
+
+        if (!writer.writeFile(entryName(name), &file))
+        {
+            cerr << "Can't write " << qPrintable(name) << "!" << endl;
+            return 1;
+        }
+    }
+
+    if (!writer.writeEndArchive())
+    {
+        cerr << "Can't write " << qPrintable(archiveName) << "!" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+//Writes files to tar.gz archive, "-" archive is stdout and "-" file is stdin.
+static int tar(const QString &archiveName, const QStringList &names, int level,
+               qint64 bufferLimit)
+{
+    QFile archive;
+    if (!openFile(archive, archiveName, QIODevice::WriteOnly))
+    {
+        cerr << "Can't open " << qPrintable(archiveName) << "!" << endl;
+        return 1;
+    }
+
+    //Archive may be written to archived directory.
+    const QString archivePath = archiveName == QStringLiteral("-")
+            ? QString() : QFileInfo(archiveName).absoluteFilePath();
+
+    TarWriter writer(&archive, level);
+    writer.setBufferLimit(bufferLimit);
+    for (const auto &name : names)
+    {
+        //Files of directory with paths relative to it.
+        QStringList files;
+        const bool dir = QFileInfo(name).isDir();
+        if (dir)
+        {
+            QDirIterator it(name, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext())
+                files.append(it.next());
+        }
+        else
+            files.append(name);
+
+        for (const auto &fileName : files)
+        {
+            if (fileName != QStringLiteral("-")
+                    && QFileInfo(fileName).absoluteFilePath() == archivePath)
+                continue;
+
+            QFile file;
+            if (!openFile(file, fileName, QIODevice::ReadOnly))
+            {
+                cerr << "Can't open " << qPrintable(fileName) << "!" << endl;
+                return 1;
+            }
+
+            const QString entry = fileName == QStringLiteral("-")
+                    ? QStringLiteral("stdin")
+                    : entryName(dir ? QDir(name).relativeFilePath(fileName) : fileName);
+            const QDateTime modified = fileName == QStringLiteral("-")
+                    ? QDateTime() : QFileInfo(fileName).lastModified();
+            if (!writer.writeFile(entry, &file, -1, modified))
+            {
+                cerr << "Can't write " << qPrintable(fileName) << ": "
+                     << qPrintable(writer.errorString()) << "!" << endl;
+                return 1;
+            }
+        }
+    }
+
+    if (!writer.finish())
+    {
+        cerr << "Can't write " << qPrintable(archiveName) << ": "
+             << qPrintable(writer.errorString()) << "!" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
     QCoreApplication::setApplicationName(QStringLiteral("compressor"));
 
     QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+                                         "Compresses source to destination (\"-\" is stdin or "
+                                         "stdout).\nWith --batch compresses files to files "
+                                         "with suffix of format.\n\"compressor zip archive files\" "
+                                         "writes files to zip archive.\n"
+                                         "\"compressor tar archive files\" writes files to tar.gz "
+                                         "archive."));
     parser.addPositionalArgument(QStringLiteral("source"), QStringLiteral("Source file."));
     parser.addPositionalArgument(QStringLiteral("destination"),
                                  QStringLiteral("Destination file."));
@@ -35,26 +345,60 @@ int main(int argc, char *argv[])
     parser.addOption(decmpOpt);
     QCommandLineOption formatOpt(QStringList{QStringLiteral("f"), QStringLiteral("format")},
                                  QStringLiteral("Compression format."),
-                                 QStringLiteral("format value Zlib, Gzip, RawDeflate"),
+                                 QStringLiteral("format value Zlib, Gzip, RawDeflate, BlockedGzip"),
                                  QStringLiteral("Zlib"));
     parser.addOption(formatOpt);
     QCommandLineOption lvlOpt(QStringList{QStringLiteral("l"), QStringLiteral("level")},
                                 QStringLiteral("Compression level. Ignores if decompress."),
                                 QStringLiteral("level value 0-9"));
     parser.addOption(lvlOpt);
+    QCommandLineOption rsyncOpt(QStringList{QStringLiteral("rsyncable")},
+                                QStringLiteral("Compress rsync friendly. Ignores if decompress."));
+    parser.addOption(rsyncOpt);
+    QCommandLineOption referenceOpt(QStringList{QStringLiteral("r"), QStringLiteral("reference")},
+                                    QStringLiteral("Compress against previous version of file, "
+                                                   "decompress with same file. Ignores format."),
+                                    QStringLiteral("file"));
+    parser.addOption(referenceOpt);
+    QCommandLineOption threadsOpt(QStringList{QStringLiteral("j"), QStringLiteral("threads")},
+                                  QStringLiteral("Number of threads."),
+                                  QStringLiteral("threads value"),
+                                  QString::number(QThread::idealThreadCount()));
+    parser.addOption(threadsOpt);
+    QCommandLineOption batchOpt(QStringList{QStringLiteral("b"), QStringLiteral("batch")},
+                                QStringLiteral("Compress or decompress all arguments files."));
+    parser.addOption(batchOpt);
+    QCommandLineOption bufferOpt(QStringList{QStringLiteral("buffer-limit")},
+                                 QStringLiteral("Max MiB of stdin buffered by tar."),
+                                 QStringLiteral("MiB"), QStringLiteral("64"));
+    parser.addOption(bufferOpt);
     parser.addHelpOption();
     parser.process(app);
 
-    using namespace std;
-
     //Check file arguments.
     const auto args = parser.positionalArguments();
-    if (args.size() < 2)
+    const auto batchMode = parser.isSet(batchOpt);
+    if (args.size() < (batchMode ? 1 : 2))
     {
-        cout << "Too few arguments!" << endl;
+        cerr << "Too few arguments!" << endl;
         return 1;
     }
 
+    //Zip subcommand.
+    if (!batchMode && args.at(0) == QStringLiteral("zip"))
+        return zip(args.at(1), args.mid(2));
+
+    //Tar subcommand.
+    if (!batchMode && args.at(0) == QStringLiteral("tar"))
+    {
+        const int level = parser.isSet(lvlOpt) ? parser.value(lvlOpt).toInt()
+                                               : Z_DEFAULT_COMPRESSION;
+        //Limit is bounded by writer, MiB are bounded before multiplication.
+        const qint64 mib = qBound<qint64>(0, parser.value(bufferOpt).toLongLong(),
+                                          TarWriter::MAX_BUFFER / (1024 * 1024) + 1);
+        return tar(args.at(1), args.mid(2), level, mib * 1024 * 1024);
+    }
+
     //Check format option if present.
     const auto frmtVal = parser.value(formatOpt);
     auto frmt = ZCompressor::ZlibFormat;
@@ -64,9 +408,12 @@ int main(int argc, char *argv[])
         frmt = ZCompressor::GzipFormat;
     else if (!frmtVal.compare(QStringLiteral("RawDeflate"), Qt::CaseInsensitive))
         frmt = ZCompressor::RawDeflateFormat;
+    else if (!frmtVal.compare(QStringLiteral("BlockedGzip"), Qt::CaseInsensitive))
+        frmt = ZCompressor::BlockedGzipFormat;
     else
     {
-        cout << "Invalid compression format! Must be Zlib, Gzip or RawDeflate." << endl;
+        cerr << "Invalid compression format! Must be Zlib, Gzip, RawDeflate or BlockedGzip."
+             << endl;
         return 1;
     }
 
@@ -82,7 +429,7 @@ int main(int argc, char *argv[])
         {
             if (!lvlVal.isEmpty())
             {
-                cout << "Invalid compression level! Must be from 0 to 9." << endl;
+                cerr << "Invalid compression level! Must be from 0 to 9." << endl;
                 return 1;
             }
             else
@@ -90,40 +437,32 @@ int main(int argc, char *argv[])
         }
         else if (lvl < 0 || lvl > 9)
         {
-            cout << "Invalid compression level range! Must be from 0 to 9." << endl;
+            cerr << "Invalid compression level range! Must be from 0 to 9." << endl;
             return 1;
         }
     }
 
-    //Open files.
-    QFile src(args.at(0));
-    QFile dest(args.at(1));
-    if (!src.open(QIODevice::ReadOnly) || !dest.open(QIODevice::WriteOnly))
+    //Check number of threads.
+    auto ok = false;
+    const auto threads = parser.value(threadsOpt).toInt(&ok);
+    if (!ok || threads < 1)
     {
-        //Files closes in destructor if necessary.
-        cout << "Can't open source or destination file!" << endl;
+        cerr << "Invalid number of threads!" << endl;
         return 1;
     }
 
-    //Compress or decompress.
-    auto ret = 0;
-    if (decmp)
-        ret = ZCompressor::inf(&src, &dest, frmt);
-    else
-        ret = ZCompressor::def(&src, &dest, lvl, frmt);
-
-    src.close();
-    dest.close();
+    const Settings settings{decmp, lvl, frmt, parser.isSet(rsyncOpt)
+                ? ZCompressor::RsyncableOption : ZCompressor::NoOptions, threads,
+                parser.value(referenceOpt)};
+    if (batchMode)
+        return batch(args, settings);
 
-    //Success or failed compression.
-    if (ret == 0)
+    //Compress or decompress, messages don't mix with data written to stdout.
+    if (process(args.at(0), args.at(1), settings) != Z_OK)
     {
-        cout << "Success!" << endl;
-        return 0;
-    }
-    else
-    {
-        cout << "Failed!" << endl;
+        cerr << "Failed!" << endl;
         return 1;
     }
+
+    return 0;
 }
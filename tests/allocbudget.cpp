@@ -0,0 +1,353 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "allocstats.h"
+#include "zcompressor.h"
+#include "zipwriter.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <cstdio>
+#include <cstring>
+
+//Budgets of heap allocations and device calls of ZCompressor and ZipWriter. Every ZCompressor
+//call and ZipWriter::writeBytes after warm up must not allocate (blocked gzip only appends index
+//of blocks). Device writes are full chunks and one rest of output per write call, so there are
+//few writes per MiB even for short writes. File of zip archive costs fixed allocations (zlib
+//stream, header, name) and fixed device writes.
+
+static const int CHUNK = 16384;
+static const int WRITE = 65536;
+static const int SIZE = 8 * 1024 * 1024;
+static const int WARM_UP = 1024 * 1024;
+static const int WRITES_PER_MIB = 96;
+//Small files written to zip archive after warm up.
+static const int FILES = 64;
+static const int FILE_SIZE = 4096;
+//Deflate state, window, hash chains, pending buffer, header data, UTF-8 name and growth of list
+//of headers.
+static const int FILE_ALLOCATIONS = 10;
+//Local header, name, compressed data and data descriptor (sequential device).
+static const int FILE_WRITES = 4;
+
+//Sequential device counting calls, written data is only counted, read data is given array.
+class CountingDevice : public QIODevice
+{
+public:
+    explicit CountingDevice(const QByteArray &data = QByteArray())
+        : m_data(data)
+    {
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    qint64 bytesAvailable() const override
+    {
+        return m_data.size() - m_pos + QIODevice::bytesAvailable();
+    }
+
+    qint64 reads() const noexcept
+    {
+        return m_reads;
+    }
+
+    qint64 writes() const noexcept
+    {
+        return m_writes;
+    }
+
+    qint64 written() const noexcept
+    {
+        return m_written;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        ++m_reads;
+        const int size = static_cast<int>(qMin<qint64>(maxlen, m_data.size() - m_pos));
+        memcpy(data, m_data.constData() + m_pos, static_cast<size_t>(size));
+        m_pos += size;
+        return size;
+    }
+
+    qint64 writeData(const char *data, qint64 len) override
+    {
+        Q_UNUSED(data);
+        ++m_writes;
+        m_written += len;
+        return len;
+    }
+
+private:
+    QByteArray m_data;
+    int m_pos{0};
+    qint64 m_reads{0};
+    qint64 m_writes{0};
+    qint64 m_written{0};
+};
+
+struct Format
+{
+    ZCompressor::CompressFormat format;
+    const char *name;
+};
+
+static const Format formats[] = {
+    {ZCompressor::ZlibFormat, "zlib"},
+    {ZCompressor::GzipFormat, "gzip"},
+    {ZCompressor::RawDeflateFormat, "raw"},
+    {ZCompressor::BlockedGzipFormat, "bgzf"}
+};
+
+//Words of text or random bytes (xorshift, same sample for every run).
+static QByteArray sample(bool text)
+{
+    static const char *words[] = {"device ", "stream ", "deflate ", "chunk ", "block ", "index ",
+                                  "window ", "member ", "header ", "of ", "the ", "\n"};
+    QByteArray data;
+    data.reserve(SIZE + 16);
+    quint32 x = 2463534242u;
+    while (data.size() < SIZE)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if (text)
+            data.append(words[x % (sizeof(words) / sizeof(words[0]))]);
+        else
+            data.append(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+    data.resize(SIZE);
+    return data;
+}
+
+static bool fail(const char *format, const char *data, const char *what, qint64 value,
+                 qint64 budget)
+{
+    fprintf(stderr, "FAIL %s %s: %s %lld, budget %lld\n", format, data, what,
+            static_cast<long long>(value), static_cast<long long>(budget));
+    return false;
+}
+
+//Data is written by WRITE bytes, calls after WARM_UP are checked.
+static bool testWrite(const QByteArray &data, const Format &format, const char *name)
+{
+    CountingDevice device;
+    device.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    ZCompressor cmprs(&device);
+    cmprs.setCompressFormat(format.format);
+    if (!cmprs.open(QIODevice::WriteOnly | QIODevice::Unbuffered))
+        return fail(format.name, name, "open", 0, 0);
+
+    qint64 allocations = 0;
+    for (int i = 0; i < data.size(); i += WRITE)
+    {
+        if (i == WARM_UP)
+            allocations = AllocStats::count();
+        if (cmprs.write(data.constData() + i, WRITE) != WRITE)
+            return fail(format.name, name, "write", i, 0);
+    }
+    allocations = AllocStats::count() - allocations;
+    cmprs.close();
+
+    //Blocked gzip appends index of blocks, vector grows by steps.
+    const qint64 blocks = (data.size() - WARM_UP) / BlockedGzip::BLOCK;
+    const qint64 allocBudget = format.format == ZCompressor::BlockedGzipFormat ? blocks / 8 : 0;
+    if (allocations > allocBudget)
+        return fail(format.name, name, "allocations", allocations, allocBudget);
+
+    const qint64 calls = data.size() / WRITE;
+    const qint64 budget = qMin<qint64>(device.written() / CHUNK + calls + 2,
+                                       data.size() / (1024 * 1024) * WRITES_PER_MIB);
+    if (device.writes() > budget)
+        return fail(format.name, name, "device writes", device.writes(), budget);
+
+    printf("%s %s write: %lld allocations, %.1f device writes per MiB\n", format.name, name,
+           static_cast<long long>(allocations), device.writes() * 1048576.0 / data.size());
+    return true;
+}
+
+//Data is read by CHUNK bytes and compared, calls after WARM_UP are checked.
+static bool testRead(const QByteArray &data, const Format &format, const char *name)
+{
+    QByteArray compressed;
+    QBuffer buffer(&compressed);
+    buffer.open(QIODevice::WriteOnly);
+    if (ZCompressor::def(data, &buffer, Z_DEFAULT_COMPRESSION, format.format) != Z_OK)
+        return fail(format.name, name, "compress", 0, 0);
+
+    CountingDevice device(compressed);
+    device.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    ZCompressor dcmprs(&device);
+    dcmprs.setCompressFormat(format.format);
+    if (!dcmprs.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return fail(format.name, name, "open", 0, 0);
+
+    char out[CHUNK];
+    qint64 allocations = 0;
+    qint64 size = 0;
+    qint64 avail;
+    do
+    {
+        if (size == WARM_UP)
+            allocations = AllocStats::count();
+        avail = dcmprs.read(out, CHUNK);
+        if (avail > data.size() - size
+                || (avail > 0 && memcmp(out, data.constData() + size, static_cast<size_t>(avail))))
+            return fail(format.name, name, "data", size, 0);
+        size += qMax<qint64>(avail, 0);
+    }
+    while (avail > 0);
+    allocations = AllocStats::count() - allocations;
+
+    if (size != data.size())
+        return fail(format.name, name, "size", size, data.size());
+    if (allocations > 0)
+        return fail(format.name, name, "allocations", allocations, 0);
+
+    //Every read fills input buffer, end is read twice at most.
+    const qint64 budget = compressed.size() / CHUNK + 3;
+    if (device.reads() > budget)
+        return fail(format.name, name, "device reads", device.reads(), budget);
+
+    printf("%s %s read: %lld allocations, %.1f device reads per MiB\n", format.name, name,
+           static_cast<long long>(allocations), device.reads() * 1048576.0 / data.size());
+    return true;
+}
+
+//File of zip archive is written by WRITE bytes, writeBytes calls after WARM_UP are checked.
+static bool testZipBytes(const QByteArray &data, const char *name)
+{
+    //Parts are copied before counting.
+    QVector<QByteArray> parts;
+    for (int i = 0; i < data.size(); i += WRITE)
+        parts.append(data.mid(i, WRITE));
+
+    CountingDevice device;
+    device.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    ZipWriter writer(&device);
+    if (!writer.writeStartFile(QStringLiteral("data")))
+        return fail("zip", name, "start file", 0, 0);
+
+    qint64 allocations = 0;
+    qint64 writes = 0;
+    qint64 written = 0;
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        if (i * WRITE == WARM_UP)
+        {
+            allocations = AllocStats::count();
+            writes = device.writes();
+            written = device.written();
+        }
+        if (!writer.writeBytes(parts.at(i)))
+            return fail("zip", name, "write", i, 0);
+    }
+    allocations = AllocStats::count() - allocations;
+    writes = device.writes() - writes;
+    written = device.written() - written;
+
+    if (!writer.writeEndFile() || !writer.writeEndArchive())
+        return fail("zip", name, "end", 0, 0);
+    if (allocations > 0)
+        return fail("zip", name, "allocations", allocations, 0);
+
+    const qint64 budget = written / CHUNK + parts.size() - WARM_UP / WRITE + 2;
+    if (writes > budget)
+        return fail("zip", name, "device writes", writes, budget);
+
+    printf("zip %s write: %lld allocations, %.1f device writes per MiB\n", name,
+           static_cast<long long>(allocations),
+           writes * 1048576.0 / (data.size() - WARM_UP));
+    return true;
+}
+
+//Small files are written by writeFile(QByteArray), files after first FILES are checked.
+static bool testZipFiles(const QByteArray &data, const char *name)
+{
+    QStringList names;
+    QVector<QByteArray> files;
+    for (int i = 0; i < FILES * 2; ++i)
+    {
+        names.append(QStringLiteral("dir/file%1.txt").arg(i));
+        files.append(data.mid(i * FILE_SIZE, FILE_SIZE));
+    }
+
+    CountingDevice device;
+    device.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    ZipWriter writer(&device);
+
+    qint64 allocations = 0;
+    qint64 writes = 0;
+    for (int i = 0; i < names.size(); ++i)
+    {
+        if (i == FILES)
+        {
+            allocations = AllocStats::count();
+            writes = device.writes();
+        }
+        if (!writer.writeFile(names.at(i), files.at(i)))
+            return fail("zip files", name, "write", i, 0);
+    }
+    allocations = AllocStats::count() - allocations;
+    writes = device.writes() - writes;
+
+    if (!writer.writeEndArchive())
+        return fail("zip files", name, "end", 0, 0);
+    if (allocations > FILES * FILE_ALLOCATIONS)
+        return fail("zip files", name, "allocations", allocations, FILES * FILE_ALLOCATIONS);
+    if (writes > FILES * FILE_WRITES)
+        return fail("zip files", name, "device writes", writes, FILES * FILE_WRITES);
+
+    printf("zip files %s: %.1f allocations, %.1f device writes per file\n", name,
+           allocations / static_cast<double>(FILES), writes / static_cast<double>(FILES));
+    return true;
+}
+
+int main()
+{
+    if (!AllocStats::isAvailable())
+        printf("allocations are not counted\n");
+
+    const QByteArray text = sample(true);
+    const QByteArray random = sample(false);
+
+    bool ok = true;
+    for (const Format &format : formats)
+    {
+        ok = testWrite(text, format, "text") && ok;
+        ok = testWrite(random, format, "random") && ok;
+        ok = testRead(text, format, "text") && ok;
+        ok = testRead(random, format, "random") && ok;
+    }
+
+    ok = testZipBytes(text, "text") && ok;
+    ok = testZipBytes(random, "random") && ok;
+    ok = testZipFiles(text, "text") && ok;
+    ok = testZipFiles(random, "random") && ok;
+
+    return ok ? 0 : 1;
+}
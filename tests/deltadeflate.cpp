@@ -0,0 +1,164 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "deltadeflate.h"
+#include "zcompressor.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <cstdio>
+
+//Round trip of DeltaDeflate for zstd frame (if built with ZCOMPRESSOR_ZSTD) and for blocks of
+//deflate, which are forced by small zstd window. Decompressor must detect format by magic number.
+
+static const int SIZE = 1024 * 1024;
+//Window of 1 KiB can't hold any sample, so deflate blocks are used.
+static const int SMALL_WINDOW_LOG = 10;
+
+//Words with numbers (xorshift, seed gives other text).
+static QByteArray text(int size, quint32 seed)
+{
+    static const char *words[] = {"alpha ", "beta ", "gamma ", "delta\n", "epsilon ", "zeta ",
+                                  "eta, ", "theta. "};
+    QByteArray data;
+    data.reserve(size + 16);
+    quint32 x = seed;
+    while (data.size() < size)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data.append(words[x % 8]);
+        if (x % 20 == 0)
+            data.append(QByteArray::number(x));
+    }
+
+    data.resize(size);
+    return data;
+}
+
+static bool isZstd(const QByteArray &data)
+{
+    return data.startsWith(QByteArray::fromRawData("\x28\xb5\x2f\xfd", 4));
+}
+
+static bool compress(const QByteArray &reference, const QByteArray &data, int windowLogMax,
+                     QByteArray &compressed)
+{
+    QBuffer src(const_cast<QByteArray*>(&data));
+    QBuffer ref(const_cast<QByteArray*>(&reference));
+    QBuffer dest(&compressed);
+    return src.open(QIODevice::ReadOnly) && ref.open(QIODevice::ReadOnly)
+            && dest.open(QIODevice::WriteOnly)
+            && DeltaDeflate::def(&src, &dest, &ref, Z_DEFAULT_COMPRESSION, ZHashers(),
+                                 windowLogMax) == Z_OK;
+}
+
+static int decompress(const QByteArray &reference, const QByteArray &compressed, QByteArray &data)
+{
+    QBuffer src(const_cast<QByteArray*>(&compressed));
+    QBuffer ref(const_cast<QByteArray*>(&reference));
+    QBuffer dest(&data);
+    if (!src.open(QIODevice::ReadOnly) || !ref.open(QIODevice::ReadOnly)
+            || !dest.open(QIODevice::WriteOnly))
+        return Z_ERRNO;
+
+    return DeltaDeflate::inf(&src, &dest, &ref, ZHashers());
+}
+
+static bool test(const char *name, const QByteArray &reference, const QByteArray &data,
+                 int windowLogMax)
+{
+    const char *path = windowLogMax > 0 ? "deflate" : "default";
+    QByteArray compressed;
+    if (!compress(reference, data, windowLogMax, compressed))
+    {
+        fprintf(stderr, "FAIL %s %s: compress\n", name, path);
+        return false;
+    }
+
+#ifdef ZCOMPRESSOR_ZSTD
+    const bool zstd = windowLogMax == 0;
+#else
+    const bool zstd = false;
+#endif
+    if (isZstd(compressed) != zstd)
+    {
+        fprintf(stderr, "FAIL %s %s: zstd frame %d, expected %d\n", name, path,
+                isZstd(compressed), zstd);
+        return false;
+    }
+
+    QByteArray out;
+    const int ret = decompress(reference, compressed, out);
+    if (ret != Z_OK || out != data)
+    {
+        fprintf(stderr, "FAIL %s %s: decompress %d, output %s\n", name, path, ret,
+                out == data ? "same" : "differs");
+        return false;
+    }
+
+    //Other reference is detected by dictionary identifier or zstd checksum, it may only give same
+    //data if changed byte isn't used.
+    if (!reference.isEmpty() && !data.isEmpty())
+    {
+        QByteArray wrong = reference;
+        wrong[data.size() / 2] = static_cast<char>(wrong.at(data.size() / 2) ^ 1);
+        QByteArray wrongOut;
+        if (decompress(wrong, compressed, wrongOut) == Z_OK && wrongOut != data)
+        {
+            fprintf(stderr, "FAIL %s %s: other reference gives other data\n", name, path);
+            return false;
+        }
+    }
+
+    printf("%s %s: %d bytes to %d, ok\n", name, path, data.size(), compressed.size());
+    return true;
+}
+
+int main()
+{
+    const QByteArray reference = text(SIZE, 2463534242u);
+
+    //Text inserted at several places.
+    QByteArray inserted = reference;
+    for (int i = 1; i <= 8; ++i)
+        inserted.insert(i * SIZE / 9, text(1000 * i, i));
+
+    const QByteArray prefix = reference.left(SIZE / 3);
+
+    bool ok = true;
+    for (int windowLogMax : {0, SMALL_WINDOW_LOG})
+    {
+        ok = test("equal", reference, reference, windowLogMax) && ok;
+        ok = test("insertion", reference, inserted, windowLogMax) && ok;
+        ok = test("empty reference", QByteArray(), inserted, windowLogMax) && ok;
+        ok = test("reference larger than data", reference, prefix, windowLogMax) && ok;
+    }
+
+    //Unchanged data takes a few percent of its size in deflate blocks.
+    QByteArray compressed;
+    if (!compress(reference, reference, SMALL_WINDOW_LOG, compressed)
+            || compressed.size() > SIZE / 20)
+    {
+        fprintf(stderr, "FAIL equal deflate: %d bytes\n", compressed.size());
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "zcompressor.h"
+#include "parallelinflate.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryFile>
+#include <cstdio>
+
+//Output of infParallel must be byte-identical to serial inf for every kind of deflate block, for
+//matches crossing chunks of ParallelInflate and for streams too small to be split. Corrupted
+//trailer fails both.
+
+static const int THREADS = 4;
+
+//Words, random runs (stored blocks in dynamic streams) and copies of earlier data at 16-32 KiB
+//distance, so matches reach back across chunk boundaries everywhere (xorshift, same every run).
+static QByteArray sample(int size)
+{
+    static const char *words[] = {"device ", "stream ", "deflate ", "chunk ", "block ", "window ",
+                                  "marker ", "symbol ", "of ", "the ", "\n"};
+    QByteArray data;
+    data.reserve(size + 64 * 1024);
+    quint32 x = 2463534242u;
+    const auto next = [&x]()
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x;
+    };
+
+    while (data.size() < size)
+    {
+        const quint32 kind = next() % 8;
+        if (kind == 0)
+        {
+            for (int i = 0; i < 1024; ++i)
+            {
+                const quint32 value = next();
+                data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+        }
+        else if (kind < 3 && data.size() > 32 * 1024)
+        {
+            const int distance = 16 * 1024 + static_cast<int>(next() % (16 * 1024));
+            const int length = 258 + static_cast<int>(next() % 4096);
+            const int from = data.size() - distance;
+            for (int i = 0; i < length; ++i)
+                data.append(data.at(from + i));
+        }
+        else
+        {
+            for (int i = 0; i < 256; ++i)
+                data.append(words[next() % (sizeof(words) / sizeof(words[0]))]);
+        }
+    }
+
+    data.resize(size);
+    return data;
+}
+
+//Stream of format by zlib with level and strategy (Z_FIXED gives only fixed blocks, level 0 only
+//stored blocks).
+static QByteArray compress(const QByteArray &data, ZCompressor::CompressFormat format, int level,
+                           int strategy)
+{
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    const int bits = format == ZCompressor::GzipFormat ? MAX_WBITS + 16 : MAX_WBITS;
+    if (deflateInit2(&strm, level, Z_DEFLATED, bits, 8, strategy) != Z_OK)
+        return QByteArray();
+
+    QByteArray result(static_cast<int>(deflateBound(&strm, static_cast<uLong>(data.size()))),
+                      Qt::Uninitialized);
+    strm.avail_in = static_cast<uInt>(data.size());
+    strm.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(data.constData()));
+    strm.avail_out = static_cast<uInt>(result.size());
+    strm.next_out = reinterpret_cast<unsigned char*>(result.data());
+    const int ret = deflate(&strm, Z_FINISH);
+    result.resize(result.size() - static_cast<int>(strm.avail_out));
+    deflateEnd(&strm);
+    return ret == Z_STREAM_END ? result : QByteArray();
+}
+
+//Mapped file is decompressed in parallel, result and output are compared with serial inf.
+static bool test(const QByteArray &name, const QByteArray &data,
+                 ZCompressor::CompressFormat format, int level, int strategy, bool corrupt)
+{
+    QByteArray compressed = compress(data, format, level, strategy);
+    if (compressed.isEmpty())
+    {
+        fprintf(stderr, "FAIL %s: compress\n", name.constData());
+        return false;
+    }
+
+    //Byte of Adler-32 of zlib or of CRC32 of gzip (ISIZE would change allocation of serial inf).
+    if (corrupt)
+    {
+        const int pos = compressed.size() - (format == ZCompressor::GzipFormat ? 8 : 1);
+        compressed[pos] = static_cast<char>(compressed.at(pos) ^ 0x55);
+    }
+
+    QByteArray expected;
+    const int serial = ZCompressor::inf(compressed, &expected, format);
+
+    QTemporaryFile temp;
+    if (!temp.open() || temp.write(compressed) != compressed.size() || !temp.flush())
+    {
+        fprintf(stderr, "FAIL %s: temporary file\n", name.constData());
+        return false;
+    }
+
+    QFile src(temp.fileName());
+    QByteArray out;
+    QBuffer dest(&out);
+    if (!src.open(QIODevice::ReadOnly) || !dest.open(QIODevice::WriteOnly))
+    {
+        fprintf(stderr, "FAIL %s: open\n", name.constData());
+        return false;
+    }
+
+    const int parallel = ZCompressor::infParallel(&src, &dest, format, THREADS);
+    if (corrupt)
+    {
+        if (serial == Z_OK || parallel == Z_OK)
+        {
+            fprintf(stderr, "FAIL %s: corrupted trailer accepted (serial %d, parallel %d)\n",
+                    name.constData(), serial, parallel);
+            return false;
+        }
+    }
+    else if (serial != Z_OK || parallel != Z_OK || expected != data || out != expected)
+    {
+        fprintf(stderr, "FAIL %s: serial %d, parallel %d, output %s\n", name.constData(), serial,
+                parallel, out == expected ? "same" : "differs");
+        return false;
+    }
+
+    printf("%s: %d compressed bytes, %d chunks, ok\n", name.constData(), compressed.size(),
+           static_cast<int>((compressed.size() + ParallelInflate::CHUNK - 1)
+                            / ParallelInflate::CHUNK));
+    return true;
+}
+
+int main()
+{
+    const QByteArray large = sample(16 * 1024 * 1024);
+    const QByteArray small = sample(static_cast<int>(ParallelInflate::CHUNK));
+
+    const struct
+    {
+        ZCompressor::CompressFormat format;
+        const char *name;
+    } formats[] = {{ZCompressor::GzipFormat, "gzip"}, {ZCompressor::ZlibFormat, "zlib"}};
+
+    bool ok = true;
+    for (const auto &format : formats)
+    {
+        const QByteArray name = format.name;
+        ok = test(name + " dynamic", large, format.format, Z_DEFAULT_COMPRESSION,
+                  Z_DEFAULT_STRATEGY, false) && ok;
+        ok = test(name + " fixed", large, format.format, Z_DEFAULT_COMPRESSION, Z_FIXED, false)
+                && ok;
+        ok = test(name + " stored", large, format.format, 0, Z_DEFAULT_STRATEGY, false) && ok;
+        ok = test(name + " small", small, format.format, Z_DEFAULT_COMPRESSION,
+                  Z_DEFAULT_STRATEGY, false) && ok;
+        ok = test(name + " corrupted trailer", large, format.format, Z_DEFAULT_COMPRESSION,
+                  Z_DEFAULT_STRATEGY, true) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,380 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "blockedgzip.h"
+#include "crc32simd.h"
+
+#include <QIODevice>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QtEndian>
+
+#include <algorithm>
+#include <climits>
+
+class BlockedGzipTask : public QRunnable
+{
+public:
+    BlockedGzipTask(const QByteArray &block, QByteArray &out, QAtomicInt &failed)
+        : m_block(block), m_out(out), m_failed(failed)
+    {
+
+    }
+
+    void run() override
+    {
+        if (!BlockedGzip::inf(reinterpret_cast<const unsigned char*>(m_block.constData()),
+                              m_block.size(), m_out))
+            m_failed.storeRelease(1);
+    }
+
+private:
+    const QByteArray &m_block;
+    QByteArray &m_out;
+    QAtomicInt &m_failed;
+};
+
+static qint64 readFully(QIODevice *device, char *data, qint64 maxlen)
+{
+    qint64 result = 0;
+    while (result < maxlen)
+    {
+        const qint64 avail = device->read(data + result, maxlen - result);
+        if (avail < 0)
+            return -1;
+        if (avail == 0)
+            break;
+
+        result += avail;
+    }
+
+    return result;
+}
+
+//static.
+int BlockedGzip::def(z_stream *strm, const unsigned char *data, int length, unsigned char *out)
+{
+    strm->avail_in = static_cast<decltype(strm->avail_in)>(length);
+    strm->next_in = const_cast<unsigned char*>(data);
+    strm->avail_out = MAX_BLOCK - HEADER - TRAILER;
+    strm->next_out = out + HEADER;
+
+    const int ret = deflate(strm, Z_FINISH);
+    const int cSize = MAX_BLOCK - HEADER - TRAILER - static_cast<int>(strm->avail_out);
+    deflateReset(strm);
+    if (ret != Z_STREAM_END)
+        return -1;
+
+    //Gzip header with extra field: ID1, ID2, CM, FLG, MTIME, XFL, OS, XLEN, SI1, SI2, SLEN.
+    static const unsigned char header[16] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+                                             0x00, 0xff, 0x06, 0x00, 'B', 'C', 0x02, 0x00};
+    const int size = HEADER + cSize + TRAILER;
+    memcpy(out, header, sizeof(header));
+    //BSIZE - block size minus 1.
+    qToLittleEndian<quint16>(static_cast<quint16>(size - 1), out + 16);
+
+    //CRC32 and ISIZE.
+    qToLittleEndian<quint32>(Crc32::update(0, data, length), out + HEADER + cSize);
+    qToLittleEndian<quint32>(static_cast<quint32>(length), out + HEADER + cSize + 4);
+
+    return size;
+}
+
+//static.
+bool BlockedGzip::inf(const unsigned char *block, int size, QByteArray &out)
+{
+    if (size < 12)
+        return false;
+
+    const int headerSize = 12 + qFromLittleEndian<quint16>(block + 10);
+    const int cSize = size - headerSize - TRAILER;
+    if (cSize < 0 || blockSize(block, headerSize) != size)
+        return false;
+
+    const quint32 crc = qFromLittleEndian<quint32>(block + size - 8);
+    const quint32 uSize = qFromLittleEndian<quint32>(block + size - 4);
+    if (uSize > static_cast<quint32>(MAX_BLOCK))
+        return false;
+
+    out.resize(static_cast<int>(uSize));
+
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    strm.avail_in = 0;
+    strm.next_in = reinterpret_cast<decltype(strm.next_in)>(Z_NULL);
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+        return false;
+
+    strm.avail_in = static_cast<decltype(strm.avail_in)>(cSize);
+    strm.next_in = const_cast<unsigned char*>(block + headerSize);
+    strm.avail_out = uSize;
+    strm.next_out = reinterpret_cast<unsigned char*>(out.data());
+
+    const int ret = inflate(&strm, Z_FINISH);
+    const bool ok = ret == Z_STREAM_END && strm.avail_out == 0;
+    inflateEnd(&strm);
+
+    return ok && Crc32::update(0, out.constData(), uSize) == crc;
+}
+
+//static.
+bool BlockedGzip::readBlock(QIODevice *device, QByteArray &block)
+{
+    //Fixed part of header.
+    block.resize(12);
+    qint64 avail = readFully(device, block.data(), 12);
+    if (avail == 0)
+    {
+        block.clear();
+        return true;
+    }
+
+    if (avail != 12)
+        return false;
+
+    const int xlen = qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(block.constData())
+                                                + 10);
+    block.resize(12 + xlen);
+    if (readFully(device, block.data() + 12, xlen) != xlen)
+        return false;
+
+    const int size = blockSize(reinterpret_cast<const unsigned char*>(block.constData()),
+                               block.size());
+    if (size < block.size())
+        return false;
+
+    const int headerSize = block.size();
+    block.resize(size);
+    return readFully(device, block.data() + headerSize, size - headerSize) == size - headerSize;
+}
+
+//static.
+int BlockedGzip::blockSize(const unsigned char *header, int length)
+{
+    //Only extra field flag allowed.
+    if (length < 12 || header[0] != 0x1f || header[1] != 0x8b || header[2] != 0x08
+            || header[3] != 0x04)
+        return -1;
+
+    const int xlen = qFromLittleEndian<quint16>(header + 10);
+    if (length < 12 + xlen)
+        return -1;
+
+    //Subfields: SI1, SI2, SLEN, data.
+    for (int i = 12; i + 4 <= 12 + xlen;)
+    {
+        const int slen = qFromLittleEndian<quint16>(header + i + 2);
+        if (header[i] == 'B' && header[i + 1] == 'C' && slen == 2 && i + 6 <= 12 + xlen)
+            return qFromLittleEndian<quint16>(header + i + 4) + 1;
+
+        i += 4 + slen;
+    }
+
+    return -1;
+}
+
+//static.
+QByteArray BlockedGzip::eofBlock()
+{
+    static const char block[28] = {0x1f, char(0x8b), 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                   char(0xff), 0x06, 0x00, 'B', 'C', 0x02, 0x00, 0x1b, 0x00,
+                                   0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    return QByteArray::fromRawData(block, sizeof(block));
+}
+
+//static.
+int BlockedGzip::inf(QIODevice *src, QIODevice *dest, int threads, const ZHashers &hashers)
+{
+    threads = qMax(1, threads);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    //Blocks are decompressed while next blocks are read, written in order after batch.
+    const int batch = threads * 4;
+    QVector<QByteArray> blocks(batch);
+    QVector<QByteArray> outs(batch);
+    QAtomicInt failed(0);
+    bool end = false;
+    while (!end)
+    {
+        int count = 0;
+        for (; count < batch; ++count)
+        {
+            if (!readBlock(src, blocks[count]))
+            {
+                pool.waitForDone();
+                return Z_DATA_ERROR;
+            }
+
+            if (blocks.at(count).isEmpty())
+            {
+                end = true;
+                break;
+            }
+
+            pool.start(new BlockedGzipTask(blocks.at(count), outs[count], failed));
+        }
+
+        pool.waitForDone();
+        if (failed.loadAcquire())
+            return Z_DATA_ERROR;
+
+        for (int i = 0; i < count; ++i)
+        {
+            addHashData(hashers, outs.at(i).constData(), outs.at(i).size());
+            if (dest->write(outs.at(i)) != outs.at(i).size())
+                return Z_ERRNO;
+        }
+    }
+
+    return Z_OK;
+}
+
+int BlockedGzipIndex::block(quint64 uncompressedOffset) const
+{
+    const auto it = std::upper_bound(m_blocks.constBegin(), m_blocks.constEnd(),
+                                     uncompressedOffset,
+                                     [](quint64 offset, const QPair<quint64, quint64> &block)
+    {
+        return offset < block.second;
+    });
+
+    return static_cast<int>(it - m_blocks.constBegin()) - 1;
+}
+
+bool BlockedGzipIndex::build(QIODevice *device)
+{
+    clear();
+    if (device->isSequential())
+        return false;
+
+    quint64 cOffset = 0;
+    quint64 uOffset = 0;
+    QByteArray header;
+    for (;;)
+    {
+        if (!device->seek(static_cast<qint64>(cOffset)))
+            return false;
+
+        header = device->read(12);
+        if (header.isEmpty())
+            break;
+
+        if (header.size() != 12)
+            return false;
+
+        header += device->read(qFromLittleEndian<quint16>(
+                                   reinterpret_cast<const uchar*>(header.constData()) + 10));
+        const int size = BlockedGzip::blockSize(
+                    reinterpret_cast<const unsigned char*>(header.constData()), header.size());
+        if (size < header.size() + BlockedGzip::TRAILER
+                || !device->seek(static_cast<qint64>(cOffset) + size - 4))
+            return false;
+
+        //ISIZE of block.
+        const QByteArray trailer = device->read(4);
+        if (trailer.size() != 4)
+            return false;
+
+        const quint32 uSize = qFromLittleEndian<quint32>(
+                    reinterpret_cast<const uchar*>(trailer.constData()));
+        //Empty blocks (end of file) are not indexed.
+        if (uSize > 0)
+            append(cOffset, uOffset);
+
+        cOffset += static_cast<quint64>(size);
+        uOffset += uSize;
+    }
+
+    return true;
+}
+
+bool BlockedGzipIndex::load(QIODevice *device)
+{
+    clear();
+
+    //Number of entries, then pairs of offsets for every block except first.
+    const QByteArray count = device->read(8);
+    if (count.size() != 8)
+        return false;
+
+    const quint64 entries = qFromLittleEndian<quint64>(
+                reinterpret_cast<const uchar*>(count.constData()));
+    //Count is untrusted, entries must fit in rest of file and in array (no overflow of size).
+    quint64 maxEntries = (INT_MAX - 1) / 16;
+    if (!device->isSequential())
+        maxEntries = qMin<quint64>(maxEntries,
+                                   static_cast<quint64>(qMax<qint64>(0, device->size()
+                                                                     - device->pos())) / 16);
+    if (entries > maxEntries)
+        return false;
+
+    const QByteArray data = device->read(static_cast<qint64>(entries * 16));
+    if (static_cast<quint64>(data.size()) != entries * 16)
+        return false;
+
+    const uchar *offsets = reinterpret_cast<const uchar*>(data.constData());
+    append(0, 0);
+    for (quint64 i = 0; i < entries; ++i)
+        append(qFromLittleEndian<quint64>(offsets + i * 16),
+               qFromLittleEndian<quint64>(offsets + i * 16 + 8));
+
+    return true;
+}
+
+bool BlockedGzipIndex::save(QIODevice *device) const
+{
+    const int entries = qMax(0, m_blocks.size() - 1);
+    QByteArray data(8 + entries * 16, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar*>(data.data());
+    qToLittleEndian<quint64>(static_cast<quint64>(entries), out);
+    for (int i = 0; i < entries; ++i)
+    {
+        qToLittleEndian<quint64>(m_blocks.at(i + 1).first, out + 8 + i * 16);
+        qToLittleEndian<quint64>(m_blocks.at(i + 1).second, out + 16 + i * 16);
+    }
+
+    return device->write(data) == data.size();
+}
+
+QByteArray BlockedGzipIndex::read(QIODevice *device, qint64 offset, qint64 maxlen) const
+{
+    QByteArray result;
+    const int first = block(static_cast<quint64>(offset));
+    if (first < 0 || !device->seek(static_cast<qint64>(compressedOffset(first))))
+        return result;
+
+    qint64 skip = offset - static_cast<qint64>(uncompressedOffset(first));
+    QByteArray compressed;
+    QByteArray out;
+    while (result.size() < maxlen && BlockedGzip::readBlock(device, compressed)
+           && !compressed.isEmpty())
+    {
+        if (!BlockedGzip::inf(reinterpret_cast<const unsigned char*>(compressed.constData()),
+                              compressed.size(), out) || skip > out.size())
+            break;
+
+        result.append(out.constData() + skip,
+                      static_cast<int>(qMin<qint64>(out.size() - skip, maxlen - result.size())));
+        skip = 0;
+    }
+
+    return result;
+}
@@ -0,0 +1,104 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLOCKEDGZIP_H
+#define BLOCKEDGZIP_H
+
+#include "zhasher.h"
+
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include <zlib.h>
+
+class QIODevice;
+
+//Blocked gzip (BGZF) - independent gzip members, block size in "BC" extra subfield.
+class BlockedGzip
+{
+public:
+    //Max uncompressed size of block, compressed block with header fits in 64 KiB.
+    constexpr static int BLOCK{0xff00};
+    //Max size of compressed block.
+    constexpr static int MAX_BLOCK{0x10000};
+    //Header with BC subfield only and trailer.
+    constexpr static int HEADER{18};
+    constexpr static int TRAILER{8};
+
+    //Compresses data to block with raw deflate stream (reset after block), out must have MAX_BLOCK
+    //bytes. Returns size of block or -1 on error.
+    static int def(z_stream *strm, const unsigned char *data, int length, unsigned char *out);
+    //Decompresses whole block to out, checks CRC32 and size.
+    static bool inf(const unsigned char *block, int size, QByteArray &out);
+    //Reads next block from device, empty block at end of device, false on error.
+    static bool readBlock(QIODevice *device, QByteArray &block);
+    //Size of block (BSIZE + 1), header is fixed part and extra field. -1 if not a blocked gzip.
+    static int blockSize(const unsigned char *header, int length);
+    //Empty block marks end of file.
+    static QByteArray eofBlock();
+
+    //Decompresses blocks from src in several threads, hashers are fed in order of blocks.
+    static int inf(QIODevice *src, QIODevice *dest, int threads,
+                   const ZHashers &hashers = ZHashers());
+};
+
+//Index of blocks (.gzi): compressed and uncompressed offsets of every block.
+class BlockedGzipIndex
+{
+public:
+    void clear()
+    {
+        m_blocks.clear();
+    }
+
+    void append(quint64 compressedOffset, quint64 uncompressedOffset)
+    {
+        m_blocks.append(qMakePair(compressedOffset, uncompressedOffset));
+    }
+
+    int size() const
+    {
+        return m_blocks.size();
+    }
+
+    quint64 compressedOffset(int block) const
+    {
+        return m_blocks.at(block).first;
+    }
+
+    quint64 uncompressedOffset(int block) const
+    {
+        return m_blocks.at(block).second;
+    }
+
+    //Block containing uncompressed offset.
+    int block(quint64 uncompressedOffset) const;
+
+    //Builds index from blocked gzip device, reads only headers and trailers.
+    bool build(QIODevice *device);
+    //Loads and saves index in .gzi format (bgzip compatible).
+    bool load(QIODevice *device);
+    bool save(QIODevice *device) const;
+
+    //Reads up to maxlen bytes at uncompressed offset, only blocks of range are decompressed.
+    QByteArray read(QIODevice *device, qint64 offset, qint64 maxlen) const;
+
+private:
+    QVector<QPair<quint64, quint64>> m_blocks;
+};
+
+#endif // BLOCKEDGZIP_H
@@ -0,0 +1,258 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "crc32simd.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QVector>
+#include <zlib.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC32_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32_TARGET
+#else
+#define CRC32_TARGET __attribute__((target("pclmul,sse4.1")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32_ARM
+#include <arm_acle.h>
+#endif
+
+//zlib crc32 takes uInt length.
+static quint32 crc32Zlib(quint32 crc, const unsigned char *data, qint64 len)
+{
+    uLong result = crc;
+    while (len > 0)
+    {
+        const uInt part = static_cast<uInt>(qMin<qint64>(len, 1 << 30));
+        result = crc32(result, data, part);
+        data += part;
+        len -= part;
+    }
+
+    return static_cast<quint32>(result);
+}
+
+#ifdef CRC32_PCLMUL
+//Folds 64 bytes per step by 4 x 128 bit registers, then 16 bytes, reduces to 32 bits by Barrett
+//reduction (Intel "Fast CRC Computation Using PCLMULQDQ"). Length is multiple of 16 and at least
+//64, crc is not inverted.
+CRC32_TARGET static quint32 crc32Fold(quint32 crc, const unsigned char *data, qint64 len)
+{
+    alignas(16) static const quint64 k1k2[2] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const quint64 k3k4[2] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const quint64 k5k0[2] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const quint64 poly[2] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    const __m128i *in = reinterpret_cast<const __m128i*>(data);
+    x1 = _mm_loadu_si128(in);
+    x2 = _mm_loadu_si128(in + 1);
+    x3 = _mm_loadu_si128(in + 2);
+    x4 = _mm_loadu_si128(in + 3);
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    in += 4;
+    len -= 64;
+
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(in));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(in + 1));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(in + 2));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(in + 3));
+        in += 4;
+        len -= 64;
+    }
+
+    //Fold 4 registers to one.
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (len >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(in)), x5);
+        ++in;
+        len -= 16;
+    }
+
+    //Fold 128 bits to 64 bits.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x00), x2);
+
+    //Barrett reduction to 32 bits.
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<quint32>(_mm_extract_epi32(x1, 1));
+}
+
+static quint32 crc32Pclmul(quint32 crc, const unsigned char *data, qint64 len)
+{
+    if (len >= 64)
+    {
+        const qint64 folded = len & ~qint64(15);
+        crc = ~crc32Fold(~crc, data, folded);
+        data += folded;
+        len -= folded;
+    }
+
+    return crc32Zlib(crc, data, len);
+}
+
+static bool hasPclmul()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    //ECX: PCLMULQDQ bit 1, SSE4.1 bit 19.
+    return (info[2] & (1 << 1)) && (info[2] & (1 << 19));
+#else
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+#endif
+
+#ifdef CRC32_ARM
+static quint32 crc32Arm(quint32 crc, const unsigned char *data, qint64 len)
+{
+    crc = ~crc;
+    for (; len > 0 && (reinterpret_cast<quintptr>(data) & 7); --len)
+        crc = __crc32b(crc, *data++);
+
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        quint64 word;
+        memcpy(&word, data, 8);
+        crc = __crc32d(crc, word);
+    }
+
+    for (; len > 0; --len)
+        crc = __crc32b(crc, *data++);
+
+    return ~crc;
+}
+#endif
+
+typedef quint32 (*Crc32Func)(quint32, const unsigned char*, qint64);
+
+static Crc32Func crc32Func()
+{
+#if defined(CRC32_PCLMUL)
+    return hasPclmul() ? crc32Pclmul : crc32Zlib;
+#elif defined(CRC32_ARM)
+    return crc32Arm;
+#else
+    return crc32Zlib;
+#endif
+}
+
+class Crc32Task : public QRunnable
+{
+public:
+    Crc32Task(const unsigned char *data, qint64 len, quint32 &crc, QSemaphore &done)
+        : m_data(data), m_len(len), m_crc(crc), m_done(done)
+    {
+
+    }
+
+    void run() override
+    {
+        m_crc = Crc32::update(0, m_data, m_len);
+        m_done.release();
+    }
+
+private:
+    const unsigned char *m_data;
+    qint64 m_len;
+    quint32 &m_crc;
+    QSemaphore &m_done;
+};
+
+//static.
+quint32 Crc32::update(quint32 crc, const unsigned char *data, qint64 len)
+{
+    //Selected once, thread safe initialization.
+    static const Crc32Func func = crc32Func();
+    return func(crc, data, len);
+}
+
+//static.
+quint32 Crc32::update(quint32 crc, const unsigned char *data, qint64 len, int threads)
+{
+    const int parts = static_cast<int>(qMin<qint64>(qMax(1, threads), len / (PARALLEL / 2)));
+    if (len < PARALLEL || parts < 2)
+        return update(crc, data, len);
+
+    //First part is computed by current thread, last part takes remainder.
+    const qint64 part = len / parts;
+    QVector<quint32> crcs(parts);
+    //Threads of pool are kept between calls (every mapped window of file). Pool is not global,
+    //so callers running in global pool can't wait for their own queued parts.
+    static QThreadPool pool;
+    QSemaphore done;
+    for (int i = 1; i < parts; ++i)
+        pool.start(new Crc32Task(data + i * part, i == parts - 1 ? len - i * part : part,
+                                 crcs[i], done));
+
+    crc = update(crc, data, part);
+    done.acquire(parts - 1);
+    for (int i = 1; i < parts; ++i)
+    {
+        const qint64 size = i == parts - 1 ? len - i * part : part;
+        crc = static_cast<quint32>(crc32_combine(crc, crcs.at(i), static_cast<z_off_t>(size)));
+    }
+
+    return crc;
+}
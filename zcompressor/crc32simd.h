@@ -0,0 +1,42 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CRC32SIMD_H
+#define CRC32SIMD_H
+
+#include <QtGlobal>
+
+//CRC32 (zip, gzip) by carry-less multiplication (PCLMULQDQ, selected at runtime) or ARMv8 CRC
+//instructions (if compiled for them), zlib crc32 otherwise. Values are compatible with zlib.
+class Crc32
+{
+public:
+    //Buffers from this size are split between threads and parts are joined by crc32_combine.
+    constexpr static qint64 PARALLEL{8 * 1024 * 1024};
+
+    static quint32 update(quint32 crc, const unsigned char *data, qint64 len);
+    //Same in several threads for large buffers.
+    static quint32 update(quint32 crc, const unsigned char *data, qint64 len, int threads);
+
+    static quint32 update(quint32 crc, const char *data, qint64 len)
+    {
+        return update(crc, reinterpret_cast<const unsigned char*>(data), len);
+    }
+};
+
+#endif // CRC32SIMD_H
@@ -0,0 +1,512 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "deltadeflate.h"
+#include "filemapper.h"
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QVector>
+#include <zlib.h>
+#ifdef ZCOMPRESSOR_ZSTD
+#include <zstd.h>
+#endif
+
+#include <cstring>
+
+//Whole reference (mapped if possible) with index of anchors.
+class DeltaReference
+{
+public:
+    explicit DeltaReference(QIODevice *device)
+        : m_mapper(device, qMax<qint64>(device->isSequential() ? 1
+                                                               : device->size() - device->pos(),
+                                        1))
+    {
+        if (m_mapper.isValid() && m_mapper.next())
+        {
+            m_ref = m_mapper.data();
+            m_size = m_mapper.size();
+        }
+        else
+        {
+            m_data = device->readAll();
+            m_ref = reinterpret_cast<const unsigned char*>(m_data.constData());
+            m_size = m_data.size();
+        }
+
+        //Table of last anchor for every hash (anchor number plus one, 0 - empty), twice more
+        //entries than anchors up to INDEX_BITS.
+        const qint64 anchors = m_size / DeltaDeflate::INDEX_STEP;
+        int bits = 10;
+        while (bits < DeltaDeflate::INDEX_BITS && (qint64(1) << bits) < anchors * 2)
+            ++bits;
+
+        m_index.fill(0, 1 << bits);
+        m_mask = (1u << bits) - 1;
+        quint32 anchor = 1;
+        for (qint64 pos = 0; pos + DeltaDeflate::ANCHOR <= m_size;
+             pos += DeltaDeflate::INDEX_STEP, ++anchor)
+            m_index[static_cast<int>(hash(m_ref + pos) & m_mask)] = anchor;
+    }
+
+    const unsigned char* data() const noexcept
+    {
+        return m_ref;
+    }
+
+    qint64 size() const noexcept
+    {
+        return m_size;
+    }
+
+    //Range of reference used as dictionary of block at pos, length is 0 without dictionary.
+    void dictionary(qint64 pos, qint64 shift, const unsigned char *&dict, qint64 &length) const
+    {
+        const qint64 end = qBound<qint64>(0, pos + shift + DeltaDeflate::BLOCK, m_size);
+        const qint64 start = qBound<qint64>(0, end - DeltaDeflate::DICTIONARY, end);
+        dict = m_ref + start;
+        length = end - start;
+    }
+
+    //Offset of reference from data after block at pos, kept if end of block isn't found.
+    qint64 nextShift(const unsigned char *block, int size, qint64 pos, qint64 shift) const;
+
+private:
+    static quint64 hash(const unsigned char *data)
+    {
+        quint64 h = 0;
+        for (int i = 0; i < DeltaDeflate::ANCHOR; i += 8)
+        {
+            quint64 v;
+            memcpy(&v, data + i, 8);
+            h = (h ^ v) * Q_UINT64_C(0x9e3779b97f4a7c15);
+        }
+
+        return h ^ (h >> 29);
+    }
+
+    FileMapper m_mapper;
+    QByteArray m_data;
+    const unsigned char *m_ref{nullptr};
+    qint64 m_size{0};
+    QVector<quint32> m_index;
+    quint64 m_mask{0};
+};
+
+qint64 DeltaReference::nextShift(const unsigned char *block, int size, qint64 pos,
+                                 qint64 shift) const
+{
+    const int anchorSize = DeltaDeflate::ANCHOR;
+    if (size < anchorSize || m_size < anchorSize)
+        return shift;
+
+    const unsigned char *anchor = block + size - anchorSize;
+    const qint64 anchorPos = pos + size - anchorSize;
+    const qint64 expected = anchorPos + shift;
+
+    //Unchanged or changed in place.
+    if (expected >= 0 && expected <= m_size - anchorSize
+            && !memcmp(m_ref + expected, anchor, anchorSize))
+        return shift;
+
+    //Nearest occurrence to expected position.
+    const qint64 first = qMax<qint64>(0, expected - DeltaDeflate::RANGE);
+    const qint64 last = qMin(m_size - anchorSize, expected + DeltaDeflate::RANGE);
+    qint64 found = -1;
+    for (qint64 i = first; i <= last; ++i)
+    {
+        const void *next = memchr(m_ref + i, anchor[0], static_cast<size_t>(last - i + 1));
+        if (!next)
+            break;
+
+        i = static_cast<const unsigned char*>(next) - m_ref;
+        if (found >= 0 && i - expected >= qAbs(found - expected))
+            break;
+
+        if (!memcmp(m_ref + i, anchor, anchorSize))
+            found = i;
+    }
+
+    if (found >= 0)
+        return found - anchorPos;
+
+    //Data moved far: one of last INDEX_STEP anchors of block is at indexed position if present.
+    for (int i = size - anchorSize; i >= 0 && i > size - anchorSize - DeltaDeflate::INDEX_STEP;
+         --i)
+    {
+        const quint32 anchor = m_index.at(static_cast<int>(hash(block + i) & m_mask));
+        const qint64 candidate = (static_cast<qint64>(anchor) - 1) * DeltaDeflate::INDEX_STEP;
+        if (anchor > 0 && !memcmp(m_ref + candidate, block + i, anchorSize))
+            return candidate - (pos + i);
+    }
+
+    return shift;
+}
+
+static qint64 readFully(QIODevice *device, char *data, qint64 maxlen)
+{
+    qint64 result = 0;
+    while (result < maxlen)
+    {
+        const qint64 avail = device->read(data + result, maxlen - result);
+        if (avail < 0)
+            return -1;
+        if (avail == 0)
+            break;
+
+        result += avail;
+    }
+
+    return result;
+}
+
+#ifdef ZCOMPRESSOR_ZSTD
+//Window of zstd frame which holds reference and data (size of unknown data is taken as size of
+//reference), 0 if it's larger than max window (or than 2^windowLogMax if it's positive).
+static int zstdWindowLog(const DeltaReference &ref, QIODevice *src, int windowLogMax)
+{
+    const qint64 size = src->isSequential() ? ref.size() : src->size() - src->pos();
+    const qint64 total = ref.size() + qMax<qint64>(size, 0);
+    const ZSTD_bounds bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+    if (ZSTD_isError(bounds.error))
+        return 0;
+
+    const int upper = windowLogMax > 0 ? qMin(windowLogMax, bounds.upperBound) : bounds.upperBound;
+    int log = bounds.lowerBound;
+    while (log < upper && (qint64(1) << log) < total)
+        ++log;
+
+    return (qint64(1) << log) >= total ? log : 0;
+}
+
+static int writeZstd(QIODevice *dest, const ZSTD_outBuffer &out)
+{
+    const qint64 have = static_cast<qint64>(out.pos);
+    return dest->write(static_cast<const char*>(out.dst), have) == have ? Z_OK : Z_ERRNO;
+}
+
+//One frame with whole reference as prefix, long distance matching finds data moved anywhere.
+static int defZstd(QIODevice *src, QIODevice *dest, const DeltaReference &ref, int level,
+                   int windowLog, const ZHashers &hashers)
+{
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (!cctx)
+        return Z_MEM_ERROR;
+
+    //Checksum of content detects other reference on decompression.
+    const int zstdLevel = level == Z_DEFAULT_COMPRESSION ? ZSTD_CLEVEL_DEFAULT : qMax(level, 1);
+    int ret = Z_OK;
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, zstdLevel))
+            || ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, windowLog))
+            || ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1))
+            || ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1))
+            || ZSTD_isError(ZSTD_CCtx_refPrefix(cctx, ref.data(), static_cast<size_t>(ref.size()))))
+        ret = Z_STREAM_ERROR;
+
+    QByteArray in(static_cast<int>(ZSTD_CStreamInSize()), Qt::Uninitialized);
+    QByteArray out(static_cast<int>(ZSTD_CStreamOutSize()), Qt::Uninitialized);
+    bool end = false;
+    while (ret == Z_OK && !end)
+    {
+        const qint64 size = readFully(src, in.data(), in.size());
+        if (size < 0)
+        {
+            ret = Z_ERRNO;
+            break;
+        }
+
+        addHashData(hashers, in.constData(), size);
+        end = size < in.size();
+        ZSTD_inBuffer input{in.constData(), static_cast<size_t>(size), 0};
+        size_t remaining;
+        do
+        {
+            ZSTD_outBuffer output{out.data(), static_cast<size_t>(out.size()), 0};
+            remaining = ZSTD_compressStream2(cctx, &output, &input,
+                                             end ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining))
+                ret = Z_STREAM_ERROR;
+            else
+                ret = writeZstd(dest, output);
+        }
+        while (ret == Z_OK && (end ? remaining > 0 : input.pos < input.size));
+    }
+
+    ZSTD_freeCCtx(cctx);
+    return ret;
+}
+
+static int infZstd(QIODevice *src, QIODevice *dest, const DeltaReference &ref,
+                   const ZHashers &hashers)
+{
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if (!dctx)
+        return Z_MEM_ERROR;
+
+    //Window of frame holds reference.
+    const ZSTD_bounds bounds = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax);
+    int ret = Z_OK;
+    if (ZSTD_isError(bounds.error)
+            || ZSTD_isError(ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, bounds.upperBound))
+            || ZSTD_isError(ZSTD_DCtx_refPrefix(dctx, ref.data(), static_cast<size_t>(ref.size()))))
+        ret = Z_STREAM_ERROR;
+
+    QByteArray in(static_cast<int>(ZSTD_DStreamInSize()), Qt::Uninitialized);
+    QByteArray out(static_cast<int>(ZSTD_DStreamOutSize()), Qt::Uninitialized);
+    //Frame isn't complete until decompressor returns 0.
+    size_t remaining = 1;
+    while (ret == Z_OK)
+    {
+        const qint64 size = src->read(in.data(), in.size());
+        if (size < 0)
+        {
+            ret = Z_ERRNO;
+            break;
+        }
+
+        if (size == 0)
+        {
+            if (remaining != 0)
+                ret = Z_DATA_ERROR;
+            break;
+        }
+
+        //Data after frame.
+        if (remaining == 0)
+        {
+            ret = Z_DATA_ERROR;
+            break;
+        }
+
+        ZSTD_inBuffer input{in.constData(), static_cast<size_t>(size), 0};
+        while (ret == Z_OK && (input.pos < input.size || remaining > 0))
+        {
+            ZSTD_outBuffer output{out.data(), static_cast<size_t>(out.size()), 0};
+            remaining = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(remaining))
+            {
+                ret = Z_DATA_ERROR;
+                break;
+            }
+
+            addHashData(hashers, out.constData(), static_cast<qint64>(output.pos));
+            ret = writeZstd(dest, output);
+            //Input is used and output is flushed.
+            if (input.pos == input.size && output.pos < output.size)
+                break;
+
+            if (remaining == 0 && input.pos < input.size)
+                ret = Z_DATA_ERROR;
+        }
+    }
+
+    ZSTD_freeDCtx(dctx);
+    return ret;
+}
+#endif
+
+//static.
+int DeltaDeflate::def(QIODevice *src, QIODevice *dest, QIODevice *reference, int level,
+                      const ZHashers &hashers, int windowLogMax)
+{
+    const DeltaReference ref(reference);
+
+#ifdef ZCOMPRESSOR_ZSTD
+    const int windowLog = zstdWindowLog(ref, src, windowLogMax);
+    if (windowLog > 0)
+        return defZstd(src, dest, ref, level, windowLog, hashers);
+#else
+    Q_UNUSED(windowLogMax)
+#endif
+
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    int ret = deflateInit2(&strm, level, Z_DEFLATED, MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK)
+        return ret;
+
+    QByteArray block(BLOCK, Qt::Uninitialized);
+    QByteArray out(BLOCK, Qt::Uninitialized);
+    qint64 pos = 0;
+    qint64 shift = 0;
+    for (;;)
+    {
+        const qint64 size = readFully(src, block.data(), BLOCK);
+        if (size < 0)
+        {
+            ret = Z_ERRNO;
+            break;
+        }
+
+        if (size == 0)
+            break;
+
+        addHashData(hashers, block.constData(), size);
+
+        //Every block is new zlib stream with own dictionary.
+        deflateReset(&strm);
+        const unsigned char *dict;
+        qint64 length;
+        ref.dictionary(pos, shift, dict, length);
+        if (length > 0)
+            deflateSetDictionary(&strm, dict, static_cast<uInt>(length));
+
+        strm.next_in = reinterpret_cast<unsigned char*>(block.data());
+        strm.avail_in = static_cast<uInt>(size);
+        do
+        {
+            strm.next_out = reinterpret_cast<unsigned char*>(out.data());
+            strm.avail_out = static_cast<uInt>(out.size());
+            ret = deflate(&strm, Z_FINISH);
+            const qint64 have = out.size() - strm.avail_out;
+            if (dest->write(out.constData(), have) != have)
+                ret = Z_ERRNO;
+        }
+        while (ret == Z_OK);
+
+        if (ret != Z_STREAM_END)
+            break;
+
+        ret = Z_OK;
+        shift = ref.nextShift(reinterpret_cast<const unsigned char*>(block.constData()),
+                              static_cast<int>(size), pos, shift);
+        pos += size;
+        if (size < BLOCK)
+            break;
+    }
+
+    deflateEnd(&strm);
+    return ret;
+}
+
+//static.
+int DeltaDeflate::inf(QIODevice *src, QIODevice *dest, QIODevice *reference,
+                      const ZHashers &hashers)
+{
+    const DeltaReference ref(reference);
+
+    //Zstd frame starts with magic number 0xFD2FB528 (little endian).
+    const QByteArray magic = src->peek(4);
+    if (magic == QByteArray::fromRawData("\x28\xb5\x2f\xfd", 4))
+    {
+#ifdef ZCOMPRESSOR_ZSTD
+        return infZstd(src, dest, ref, hashers);
+#else
+        return Z_DATA_ERROR;
+#endif
+    }
+
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    strm.avail_in = 0;
+    strm.next_in = reinterpret_cast<decltype(strm.next_in)>(Z_NULL);
+    int ret = inflateInit2(&strm, MAX_WBITS);
+    if (ret != Z_OK)
+        return ret;
+
+    //Block is decompressed whole to find its end in reference, larger block is an error.
+    QByteArray in(BLOCK, Qt::Uninitialized);
+    QByteArray block(BLOCK + 1, Qt::Uninitialized);
+    strm.next_out = reinterpret_cast<unsigned char*>(block.data());
+    strm.avail_out = static_cast<uInt>(block.size());
+    qint64 pos = 0;
+    qint64 shift = 0;
+    bool started = false;
+    bool last = false;
+    for (;;)
+    {
+        if (strm.avail_in == 0)
+        {
+            const qint64 avail = src->read(in.data(), in.size());
+            if (avail < 0)
+            {
+                ret = Z_ERRNO;
+                break;
+            }
+
+            //Stream ends with block.
+            if (avail == 0)
+            {
+                ret = started ? Z_DATA_ERROR : Z_OK;
+                break;
+            }
+
+            strm.next_in = reinterpret_cast<unsigned char*>(in.data());
+            strm.avail_in = static_cast<uInt>(avail);
+        }
+
+        //Only last block is shorter.
+        if (last)
+        {
+            ret = Z_DATA_ERROR;
+            break;
+        }
+
+        started = true;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT)
+        {
+            const unsigned char *dict;
+            qint64 length;
+            ref.dictionary(pos, shift, dict, length);
+            if (length == 0 || inflateSetDictionary(&strm, dict, static_cast<uInt>(length)) != Z_OK)
+            {
+                ret = Z_DATA_ERROR;
+                break;
+            }
+
+            continue;
+        }
+
+        if ((ret != Z_OK && ret != Z_STREAM_END) || strm.avail_out == 0)
+        {
+            if (ret != Z_MEM_ERROR)
+                ret = Z_DATA_ERROR;
+            break;
+        }
+
+        if (ret == Z_STREAM_END)
+        {
+            const int size = block.size() - static_cast<int>(strm.avail_out);
+            addHashData(hashers, block.constData(), size);
+            if (dest->write(block.constData(), size) != size)
+            {
+                ret = Z_ERRNO;
+                break;
+            }
+
+            shift = ref.nextShift(reinterpret_cast<const unsigned char*>(block.constData()),
+                                  size, pos, shift);
+            pos += size;
+            last = size < BLOCK;
+
+            inflateReset(&strm);
+            strm.next_out = reinterpret_cast<unsigned char*>(block.data());
+            strm.avail_out = static_cast<uInt>(block.size());
+            started = false;
+        }
+    }
+
+    inflateEnd(&strm);
+    return ret;
+}
@@ -0,0 +1,59 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DELTADEFLATE_H
+#define DELTADEFLATE_H
+
+#include "zhasher.h"
+
+class QIODevice;
+
+//Compresses data against reference (previous version of data). Data is split to blocks, every
+//block is one zlib stream with reference data near same position as preset dictionary, so
+//unchanged data is coded by matches to dictionary. Position in reference follows insertions and
+//deletions: end of every block is searched in reference, decompressor does same with decompressed
+//block.
+//With ZCOMPRESSOR_ZSTD data is one zstd frame with whole reference as prefix and long distance
+//matching (unchanged data takes a few bytes per MiB), blocks of deflate are used if zstd window
+//can't hold reference and data. Decompressor detects format by zstd magic number.
+class DeltaDeflate
+{
+public:
+    //Small blocks keep distance to matching dictionary data short, so deflate finds it.
+    constexpr static int BLOCK{4 * 1024};
+    //Dictionary ends BLOCK after block start in reference.
+    constexpr static int DICTIONARY{32 * 1024};
+    //Bytes of block end searched in reference: near expected position, then by index of anchors
+    //at every INDEX_STEP bytes of reference.
+    constexpr static int ANCHOR{32};
+    constexpr static int RANGE{16 * 1024};
+    constexpr static int INDEX_STEP{64};
+    //Max bits of anchors index (64 MiB), anchors of larger reference share entries.
+    constexpr static int INDEX_BITS{24};
+
+    //Zstd window is limited to 2^windowLogMax bytes if it's positive, larger reference and data
+    //are compressed by blocks of deflate.
+    static int def(QIODevice *src, QIODevice *dest, QIODevice *reference, int level,
+                   const ZHashers &hashers, int windowLogMax = 0);
+    //Z_DATA_ERROR if reference differs (dictionary identifier or zstd checksum is checked) or if
+    //data is zstd frame and library is built without ZCOMPRESSOR_ZSTD.
+    static int inf(QIODevice *src, QIODevice *dest, QIODevice *reference,
+                   const ZHashers &hashers);
+};
+
+#endif // DELTADEFLATE_H
@@ -0,0 +1,86 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "filemapper.h"
+
+#include <QFileDevice>
+
+FileMapper::FileMapper(QIODevice *device, qint64 window)
+    : m_window(window)
+{
+    QFileDevice *file = qobject_cast<QFileDevice*>(device);
+    if (file && file->isReadable() && !file->isSequential())
+    {
+        m_offset = file->pos();
+        m_end = file->size();
+
+        //First window mapped here to check that file can be mapped.
+        m_size = qMin(m_window, m_end - m_offset);
+        if (m_size > 0)
+            m_data = file->map(m_offset, m_size);
+
+        if (m_data || m_size <= 0)
+        {
+            m_file = file;
+            m_size = qMax<qint64>(m_size, 0);
+        }
+    }
+}
+
+FileMapper::~FileMapper()
+{
+    unmap();
+}
+
+bool FileMapper::next()
+{
+    if (!m_file)
+        return false;
+
+    //First window is mapped by constructor.
+    if (m_first)
+    {
+        m_first = false;
+        return true;
+    }
+
+    unmap();
+    m_offset += m_size;
+    m_size = qMin(m_window, m_end - m_offset);
+    if (m_size <= 0)
+    {
+        m_size = 0;
+        return true;
+    }
+
+    m_data = m_file->map(m_offset, m_size);
+    return m_data != nullptr;
+}
+
+bool FileMapper::seek(qint64 consumed)
+{
+    return m_file && m_file->seek(m_offset + consumed);
+}
+
+void FileMapper::unmap()
+{
+    if (m_data)
+    {
+        m_file->unmap(m_data);
+        m_data = nullptr;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEMAPPER_H
+#define FILEMAPPER_H
+
+#include <QtGlobal>
+
+class QIODevice;
+class QFileDevice;
+
+//Maps file from current position to end by sliding windows, so data is read without copy.
+//Not valid if device is not a file or can't be mapped, device should be read as usual then.
+class FileMapper
+{
+public:
+    explicit FileMapper(QIODevice *device, qint64 window = 64 * 1024 * 1024);
+    ~FileMapper();
+
+    FileMapper(const FileMapper&) = delete;
+    FileMapper& operator=(const FileMapper&) = delete;
+
+    bool isValid() const noexcept
+    {
+        return m_file != nullptr;
+    }
+
+    //Maps next window, current window is unmapped. Size of window is 0 at end of file.
+    bool next();
+
+    const unsigned char* data() const noexcept
+    {
+        return m_data;
+    }
+
+    qint64 size() const noexcept
+    {
+        return m_size;
+    }
+
+    //True if current window is last.
+    bool atEnd() const noexcept
+    {
+        return m_offset + m_size >= m_end;
+    }
+
+    //Sets file position after consumed bytes of current window.
+    bool seek(qint64 consumed);
+
+private:
+    void unmap();
+
+    QFileDevice *m_file{nullptr};
+    qint64 m_window;
+    qint64 m_end{0};
+    //Offset of current window.
+    qint64 m_offset{0};
+    qint64 m_size{0};
+    unsigned char *m_data{nullptr};
+    bool m_first{true};
+};
+
+#endif // FILEMAPPER_H
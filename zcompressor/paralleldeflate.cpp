@@ -0,0 +1,281 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "paralleldeflate.h"
+#include "crc32simd.h"
+
+#include <QIODevice>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QVector>
+#include <QtEndian>
+
+struct ParallelDeflateBlock
+{
+    QByteArray in;
+    //Last bytes of previous block.
+    QByteArray dictionary;
+    QByteArray out;
+    uLong check;
+    bool last;
+};
+
+class ParallelDeflateTask : public QRunnable
+{
+public:
+    ParallelDeflateTask(ParallelDeflateBlock &block, int level, ZCompressor::CompressFormat format,
+                        QAtomicInt &failed)
+        : m_block(block), m_level(level), m_format(format), m_failed(failed)
+    {
+
+    }
+
+    void run() override
+    {
+        if (!(m_format == ZCompressor::BlockedGzipFormat ? defBlocked() : def()))
+            m_failed.storeRelease(1);
+    }
+
+private:
+    bool init(z_stream *strm)
+    {
+        strm->zalloc = reinterpret_cast<decltype(strm->zalloc)>(Z_NULL);
+        strm->zfree = reinterpret_cast<decltype(strm->zfree)>(Z_NULL);
+        strm->opaque = reinterpret_cast<decltype(strm->opaque)>(Z_NULL);
+        return deflateInit2(strm, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    bool def()
+    {
+        const uInt size = static_cast<uInt>(m_block.in.size());
+        const unsigned char *in = reinterpret_cast<const unsigned char*>(m_block.in.constData());
+        if (m_format == ZCompressor::GzipFormat)
+            m_block.check = Crc32::update(0, in, size);
+        else if (m_format == ZCompressor::ZlibFormat)
+            m_block.check = adler32(adler32(0, Z_NULL, 0), in, size);
+
+        z_stream strm;
+        if (!init(&strm))
+            return false;
+
+        if (!m_block.dictionary.isEmpty())
+            deflateSetDictionary(&strm, reinterpret_cast<const unsigned char*>(
+                                     m_block.dictionary.constData()),
+                                 static_cast<uInt>(m_block.dictionary.size()));
+
+        //Bound with sync flush marker, all data is compressed by one call.
+        const uLong bound = deflateBound(&strm, size) + 16;
+        m_block.out.resize(static_cast<int>(bound));
+        strm.avail_in = size;
+        strm.next_in = const_cast<unsigned char*>(in);
+        strm.avail_out = static_cast<uInt>(bound);
+        strm.next_out = reinterpret_cast<unsigned char*>(m_block.out.data());
+
+        //Not last block is byte aligned and not final.
+        const int ret = deflate(&strm, m_block.last ? Z_FINISH : Z_SYNC_FLUSH);
+        const bool ok = (m_block.last ? ret == Z_STREAM_END : ret == Z_OK)
+                && strm.avail_in == 0 && strm.avail_out > 0;
+        m_block.out.resize(static_cast<int>(bound - strm.avail_out));
+        deflateEnd(&strm);
+
+        return ok;
+    }
+
+    bool defBlocked()
+    {
+        //Blocks are independent, input is split to blocked gzip blocks.
+        z_stream strm;
+        if (!init(&strm))
+            return false;
+
+        const int count = (m_block.in.size() + BlockedGzip::BLOCK - 1) / BlockedGzip::BLOCK;
+        m_block.out.resize(count * BlockedGzip::MAX_BLOCK);
+        unsigned char *out = reinterpret_cast<unsigned char*>(m_block.out.data());
+        const unsigned char *in = reinterpret_cast<const unsigned char*>(m_block.in.constData());
+        int size = 0;
+        for (int i = 0; i < m_block.in.size(); i += BlockedGzip::BLOCK)
+        {
+            const int blockSize = BlockedGzip::def(&strm, in + i,
+                                                   qMin(BlockedGzip::BLOCK, m_block.in.size() - i),
+                                                   out + size);
+            if (blockSize < 0)
+            {
+                deflateEnd(&strm);
+                return false;
+            }
+
+            size += blockSize;
+        }
+
+        m_block.out.resize(size);
+        deflateEnd(&strm);
+        return true;
+    }
+
+    ParallelDeflateBlock &m_block;
+    int m_level;
+    ZCompressor::CompressFormat m_format;
+    QAtomicInt &m_failed;
+};
+
+//Reads up to maxlen bytes, less only at end of device.
+static qint64 readFully(QIODevice *device, char *data, qint64 maxlen)
+{
+    qint64 result = 0;
+    while (result < maxlen)
+    {
+        const qint64 avail = device->read(data + result, maxlen - result);
+        if (avail < 0)
+            return -1;
+        if (avail == 0 && (!device->isSequential() || !device->waitForReadyRead(-1)))
+            break;
+
+        result += avail;
+    }
+
+    return result;
+}
+
+static bool readBlock(QIODevice *device, QByteArray &block, int size)
+{
+    block.resize(size);
+    const qint64 avail = readFully(device, block.data(), block.size());
+    block.resize(static_cast<int>(qMax<qint64>(avail, 0)));
+
+    return avail >= 0;
+}
+
+//static.
+int ParallelDeflate::def(QIODevice *src, QIODevice *dest, int level,
+                         ZCompressor::CompressFormat format, int threads)
+{
+    if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION)
+        return Z_STREAM_ERROR;
+
+    threads = qMax(1, threads);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    const QByteArray head = header(level, format);
+    if (dest->write(head) != head.size())
+        return Z_ERRNO;
+
+    //Blocked gzip blocks are not split.
+    const int blockSize = format == ZCompressor::BlockedGzipFormat ? BlockedGzip::BLOCK * 2 : BLOCK;
+
+    //Next block is read ahead to know last block.
+    QByteArray next;
+    if (!readBlock(src, next, blockSize))
+        return Z_ERRNO;
+
+    QVector<ParallelDeflateBlock> blocks(threads * 2);
+    QAtomicInt failed(0);
+    QByteArray dictionary;
+    uLong check = format == ZCompressor::ZlibFormat ? adler32(0, Z_NULL, 0) : crc32(0, Z_NULL, 0);
+    qint64 size = 0;
+    bool last = false;
+    while (!last)
+    {
+        int count = 0;
+        for (; count < blocks.size() && !last; ++count)
+        {
+            ParallelDeflateBlock &block = blocks[count];
+            block.in.swap(next);
+            if (!readBlock(src, next, blockSize))
+            {
+                pool.waitForDone();
+                return Z_ERRNO;
+            }
+
+            last = next.isEmpty();
+            block.last = last;
+            block.dictionary = dictionary;
+            dictionary = block.in.right(DICTIONARY);
+            pool.start(new ParallelDeflateTask(block, level, format, failed));
+        }
+
+        pool.waitForDone();
+        if (failed.loadAcquire())
+            return Z_STREAM_ERROR;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const ParallelDeflateBlock &block = blocks.at(i);
+            if (dest->write(block.out) != block.out.size())
+                return Z_ERRNO;
+
+            if (format == ZCompressor::GzipFormat)
+                check = crc32_combine(check, block.check, block.in.size());
+            else if (format == ZCompressor::ZlibFormat)
+                check = adler32_combine(check, block.check, block.in.size());
+            size += block.in.size();
+        }
+    }
+
+    const QByteArray tail = trailer(check, size, format);
+    return dest->write(tail) == tail.size() ? Z_OK : Z_ERRNO;
+}
+
+//static.
+QByteArray ParallelDeflate::header(int level, ZCompressor::CompressFormat format)
+{
+    if (level == Z_DEFAULT_COMPRESSION)
+        level = 6;
+
+    QByteArray result;
+    if (format == ZCompressor::ZlibFormat)
+    {
+        //CMF (deflate, 32 KiB window) and FLG with level and check bits as zlib.
+        const int levelFlags = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+        int head = ((Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8) | (levelFlags << 6);
+        head += 31 - head % 31;
+        result.append(static_cast<char>(head >> 8));
+        result.append(static_cast<char>(head & 0xff));
+    }
+    else if (format == ZCompressor::GzipFormat)
+    {
+        //ID1, ID2, CM, FLG, MTIME, XFL, OS (Unix).
+        const char xfl = level == 9 ? 2 : (level < 2 ? 4 : 0);
+        const char head[10] = {0x1f, char(0x8b), 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, xfl, 0x03};
+        result.append(head, sizeof(head));
+    }
+
+    return result;
+}
+
+//static.
+QByteArray ParallelDeflate::trailer(uLong check, qint64 size, ZCompressor::CompressFormat format)
+{
+    QByteArray result;
+    uchar tail[8];
+    if (format == ZCompressor::ZlibFormat)
+    {
+        qToBigEndian<quint32>(static_cast<quint32>(check), tail);
+        result.append(reinterpret_cast<char*>(tail), 4);
+    }
+    else if (format == ZCompressor::GzipFormat)
+    {
+        qToLittleEndian<quint32>(static_cast<quint32>(check), tail);
+        qToLittleEndian<quint32>(static_cast<quint32>(size), tail + 4);
+        result.append(reinterpret_cast<char*>(tail), 8);
+    }
+    else if (format == ZCompressor::BlockedGzipFormat)
+        result = BlockedGzip::eofBlock();
+
+    return result;
+}
@@ -0,0 +1,42 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLELDEFLATE_H
+#define PARALLELDEFLATE_H
+
+#include "zcompressor.h"
+
+class QIODevice;
+
+//Compresses one stream in several threads (as pigz). Input is split to blocks, every block is
+//compressed separately with last 32 KiB of previous block as dictionary and ends by sync flush,
+//so compressed blocks are concatenated to one deflate stream. Check values of blocks are combined.
+class ParallelDeflate
+{
+public:
+    constexpr static int BLOCK{128 * 1024};
+    constexpr static int DICTIONARY{32 * 1024};
+
+    static int def(QIODevice *src, QIODevice *dest, int level,
+                   ZCompressor::CompressFormat format, int threads);
+
+private:
+    static QByteArray header(int level, ZCompressor::CompressFormat format);
+    static QByteArray trailer(uLong check, qint64 size, ZCompressor::CompressFormat format);
+};
+
+#endif // PARALLELDEFLATE_H
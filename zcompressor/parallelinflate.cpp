@@ -0,0 +1,861 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "parallelinflate.h"
+#include "filemapper.h"
+#include "crc32simd.h"
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
+
+//Deflate window and bits of lookup table of short codes.
+static const int WINDOW = 32768;
+static const int LUT_BITS = 10;
+//Max output of speculative chunk in symbols, larger chunks are inflated by zlib.
+static const int MAX_SYMBOLS = 64 * 1024 * 1024;
+
+//Base values and extra bits of lengths and distances (RFC 1951).
+static const quint16 LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35,
+                                        43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const quint8 LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const quint16 DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193,
+                                      12289, 16385, 24577};
+static const quint8 DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9,
+                                      9, 10, 10, 11, 11, 12, 12, 13, 13};
+//Order of code length code lengths.
+static const quint8 CODE_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1,
+                                      15};
+
+//Canonical Huffman code (as puff) with lookup table of codes up to LUT_BITS.
+struct InflateHuffman
+{
+    quint16 count[16];
+    quint16 symbol[288];
+    //Symbol << 4 | length, 0 for longer codes.
+    quint16 table[1 << LUT_BITS];
+
+    //0 for complete code, positive for incomplete, negative for over-subscribed.
+    int build(const quint8 *lengths, int n);
+};
+
+int InflateHuffman::build(const quint8 *lengths, int n)
+{
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < n; ++i)
+        ++count[lengths[i]];
+
+    //No codes, complete but decoding fails.
+    if (count[0] == n)
+    {
+        memset(table, 0, sizeof(table));
+        return 0;
+    }
+
+    int left = 1;
+    for (int len = 1; len < 16; ++len)
+    {
+        left <<= 1;
+        left -= count[len];
+        if (left < 0)
+            return left;
+    }
+
+    //Most candidates of speculative decoding fail above.
+    memset(table, 0, sizeof(table));
+    quint16 offsets[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; ++len)
+        offsets[len + 1] = offsets[len] + count[len];
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (lengths[i])
+            symbol[offsets[lengths[i]]++] = static_cast<quint16>(i);
+    }
+
+    //Codes are assigned in order of length and symbol, table is indexed by reversed code.
+    unsigned code = 0;
+    int index = 0;
+    for (int len = 1; len <= LUT_BITS; ++len)
+    {
+        for (int i = 0; i < count[len]; ++i, ++index, ++code)
+        {
+            unsigned reversed = 0;
+            for (int bit = 0; bit < len; ++bit)
+                reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+
+            for (unsigned k = reversed; k < (1u << LUT_BITS); k += 1u << len)
+                table[k] = static_cast<quint16>(symbol[index] << 4 | len);
+        }
+
+        code <<= 1;
+    }
+
+    return left;
+}
+
+//Reads deflate bits from any bit position.
+class InflateBits
+{
+public:
+    InflateBits(const unsigned char *data, qint64 size, qint64 bit)
+        : m_data(data), m_size(size), m_pos(bit >> 3)
+    {
+        fill();
+        drop(static_cast<int>(bit & 7));
+    }
+
+    //At least 56 bits are buffered, zeros after end of data.
+    void fill()
+    {
+        while (m_count <= 56)
+        {
+            m_buffer |= static_cast<quint64>(m_pos < m_size ? m_data[m_pos] : 0) << m_count;
+            ++m_pos;
+            m_count += 8;
+        }
+    }
+
+    int count() const noexcept
+    {
+        return m_count;
+    }
+
+    void drop(int n)
+    {
+        m_buffer >>= n;
+        m_count -= n;
+    }
+
+    unsigned bits(int n)
+    {
+        if (m_count < n)
+            fill();
+
+        const unsigned value = static_cast<unsigned>(m_buffer & ((quint64(1) << n) - 1));
+        drop(n);
+        return value;
+    }
+
+    //Caller fills buffer, longest code is 15 bits.
+    int decode(const InflateHuffman &h)
+    {
+        const unsigned entry = h.table[m_buffer & ((1u << LUT_BITS) - 1)];
+        if (entry)
+        {
+            drop(entry & 15);
+            return static_cast<int>(entry >> 4);
+        }
+
+        //Long code bit by bit.
+        quint64 buffer = m_buffer;
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int len = 1; len < 16; ++len)
+        {
+            code |= static_cast<int>(buffer & 1);
+            buffer >>= 1;
+            const int count = h.count[len];
+            if (code - count < first)
+            {
+                drop(len);
+                return h.symbol[index + (code - first)];
+            }
+
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+
+        return -1;
+    }
+
+    qint64 position() const noexcept
+    {
+        return m_pos * 8 - m_count;
+    }
+
+    bool overrun() const noexcept
+    {
+        return position() > m_size * 8;
+    }
+
+private:
+    const unsigned char *m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    quint64 m_buffer{0};
+    int m_count{0};
+};
+
+static const InflateHuffman& fixedLengths()
+{
+    static const InflateHuffman h = []()
+    {
+        quint8 lengths[288];
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        InflateHuffman result;
+        result.build(lengths, 288);
+        return result;
+    }();
+    return h;
+}
+
+static const InflateHuffman& fixedDistances()
+{
+    static const InflateHuffman h = []()
+    {
+        quint8 lengths[30];
+        memset(lengths, 5, 30);
+        InflateHuffman result;
+        result.build(lengths, 30);
+        return result;
+    }();
+    return h;
+}
+
+//Decodes symbols of dynamic block header to codes.
+static bool dynamicCodes(InflateBits &bits, InflateHuffman &lencode, InflateHuffman &distcode)
+{
+    const int nlen = static_cast<int>(bits.bits(5)) + 257;
+    const int ndist = static_cast<int>(bits.bits(5)) + 1;
+    const int ncode = static_cast<int>(bits.bits(4)) + 4;
+    if (nlen > 286 || ndist > 30)
+        return false;
+
+    quint8 lengths[320] = {0};
+    for (int i = 0; i < ncode; ++i)
+        lengths[CODE_ORDER[i]] = static_cast<quint8>(bits.bits(3));
+
+    //Code length code must be complete.
+    if (lencode.build(lengths, 19) != 0)
+        return false;
+
+    int index = 0;
+    while (index < nlen + ndist)
+    {
+        bits.fill();
+        int symbol = bits.decode(lencode);
+        if (symbol < 0)
+            return false;
+
+        if (symbol < 16)
+        {
+            lengths[index++] = static_cast<quint8>(symbol);
+            continue;
+        }
+
+        quint8 len = 0;
+        if (symbol == 16)
+        {
+            if (index == 0)
+                return false;
+
+            len = lengths[index - 1];
+            symbol = 3 + static_cast<int>(bits.bits(2));
+        }
+        else if (symbol == 17)
+            symbol = 3 + static_cast<int>(bits.bits(3));
+        else
+            symbol = 11 + static_cast<int>(bits.bits(7));
+
+        if (index + symbol > nlen + ndist)
+            return false;
+
+        while (symbol--)
+            lengths[index++] = len;
+    }
+
+    //End of block code is required, incomplete codes only with one symbol.
+    if (lengths[256] == 0)
+        return false;
+
+    int err = lencode.build(lengths, nlen);
+    if (err && (err < 0 || nlen != lencode.count[0] + lencode.count[1]))
+        return false;
+
+    err = distcode.build(lengths + nlen, ndist);
+    return !err || (err > 0 && ndist == distcode.count[0] + distcode.count[1]);
+}
+
+//Decodes blocks from start bit to first block ending at or after stop bit (or last block) after n
+//symbols of out. Symbols are bytes or 256 + position of unknown window (out starts by window).
+static bool decodeBlocks(const unsigned char *data, qint64 size, qint64 start, qint64 stop,
+                         QVector<quint16> &out, int &n, qint64 &end, bool &last)
+{
+    InflateBits bits(data, size, start);
+    InflateHuffman lencode, distcode;
+    quint16 *o = out.data();
+    for (;;)
+    {
+        bits.fill();
+        last = bits.bits(1);
+        const unsigned type = bits.bits(2);
+        if (type == 0)
+        {
+            //Stored block from byte boundary.
+            bits.drop(bits.count() & 7);
+            const unsigned len = bits.bits(16);
+            if (len != (~bits.bits(16) & 0xffff))
+                return false;
+
+            if (n + static_cast<int>(len) > out.size())
+            {
+                if (n - WINDOW + static_cast<int>(len) > MAX_SYMBOLS)
+                    return false;
+
+                out.resize(qMax(out.size() * 2, n + static_cast<int>(len)));
+                o = out.data();
+            }
+
+            for (unsigned i = 0; i < len; ++i)
+                o[n++] = static_cast<quint16>(bits.bits(8));
+        }
+        else if (type == 1 || type == 2)
+        {
+            const InflateHuffman *lens = &fixedLengths();
+            const InflateHuffman *dists = &fixedDistances();
+            if (type == 2)
+            {
+                if (!dynamicCodes(bits, lencode, distcode))
+                    return false;
+
+                lens = &lencode;
+                dists = &distcode;
+            }
+
+            for (;;)
+            {
+                //Longest symbol with distance is 48 bits.
+                if (bits.count() < 48)
+                    bits.fill();
+
+                if (n + 258 > out.size())
+                {
+                    if (n - WINDOW > MAX_SYMBOLS)
+                        return false;
+
+                    out.resize(out.size() * 2);
+                    o = out.data();
+                }
+
+                int symbol = bits.decode(*lens);
+                if (symbol < 256)
+                {
+                    if (symbol < 0)
+                        return false;
+
+                    o[n++] = static_cast<quint16>(symbol);
+                    continue;
+                }
+
+                if (symbol == 256)
+                    break;
+
+                symbol -= 257;
+                if (symbol >= 29)
+                    return false;
+
+                const int len = LENGTH_BASE[symbol] + static_cast<int>(bits.bits(LENGTH_EXTRA[symbol]));
+                symbol = bits.decode(*dists);
+                if (symbol < 0 || symbol >= 30)
+                    return false;
+
+                const int dist = DIST_BASE[symbol] + static_cast<int>(bits.bits(DIST_EXTRA[symbol]));
+                if (dist > n)
+                    return false;
+
+                const quint16 *from = o + n - dist;
+                for (int i = 0; i < len; ++i)
+                    o[n + i] = from[i];
+
+                n += len;
+            }
+        }
+        else
+            return false;
+
+        if (bits.overrun())
+            return false;
+
+        end = bits.position();
+        if (last || end >= stop)
+            return true;
+    }
+}
+
+//Speculatively decoded chunk.
+struct InflateChunk
+{
+    //Start bit of first block, -1 if not found.
+    qint64 start{-1};
+    qint64 end{0};
+    bool last{false};
+    QByteArray data;
+    //Decoded symbols (after window) up to last window reference, they are resolved to data.
+    QVector<quint16> symbols;
+    int unresolved{0};
+};
+
+class ParallelInflateTask : public QRunnable
+{
+public:
+    ParallelInflateTask(const unsigned char *data, qint64 size, qint64 from, qint64 stop)
+        : m_data(data), m_size(size), m_from(from), m_stop(stop)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        decode();
+        m_done.release();
+    }
+
+    void wait()
+    {
+        m_done.acquire();
+    }
+
+    //Only block at bit is needed when previous chunk is decoded, other candidates are skipped.
+    void setTarget(qint64 bit)
+    {
+        m_target.storeRelease(static_cast<int>(bit - m_from));
+    }
+
+    void cancel()
+    {
+        m_target.storeRelease(CANCELED);
+    }
+
+    InflateChunk& chunk() noexcept
+    {
+        return m_chunk;
+    }
+
+private:
+    //Target of all candidates and no candidates.
+    constexpr static int ANY{-1};
+    constexpr static int CANCELED{-2};
+
+    //First candidate decoded to stop is taken, its start is checked by end of previous chunk.
+    void decode()
+    {
+        QVector<quint16> out(WINDOW + static_cast<int>(ParallelInflate::CHUNK) * 4);
+        for (int i = 0; i < WINDOW; ++i)
+            out[i] = static_cast<quint16>(256 + i);
+
+        const qint64 limit = qMin(m_stop, m_size * 8 - 17);
+        for (qint64 bit = m_from; bit < limit; ++bit)
+        {
+            const int target = m_target.loadAcquire();
+            if (target == CANCELED || (target >= 0 && bit > m_from + target))
+                return;
+
+            if (target >= 0)
+                bit = m_from + target;
+
+            //Quick check of dynamic block header: type 2, at most 286 and 30 codes.
+            const qint64 byte = bit >> 3;
+            quint32 v = 0;
+            for (int i = 0; i < 4 && byte + i < m_size; ++i)
+                v |= static_cast<quint32>(m_data[byte + i]) << (8 * i);
+
+            v >>= bit & 7;
+            if (((v >> 1) & 3) != 2 || ((v >> 3) & 31) > 29 || ((v >> 8) & 31) > 29)
+                continue;
+
+            int n = WINDOW;
+            if (decodeBlocks(m_data, m_size, bit, m_stop, out, n, m_chunk.end, m_chunk.last))
+            {
+                m_chunk.start = bit;
+                m_chunk.data.resize(n - WINDOW);
+                char *data = m_chunk.data.data();
+                for (int i = WINDOW; i < n; ++i)
+                {
+                    data[i - WINDOW] = static_cast<char>(out.at(i));
+                    if (out.at(i) > 255)
+                        m_chunk.unresolved = i - WINDOW + 1;
+                }
+
+                m_chunk.symbols.swap(out);
+                return;
+            }
+        }
+    }
+
+    const unsigned char *m_data;
+    qint64 m_size;
+    qint64 m_from;
+    qint64 m_stop;
+    QAtomicInt m_target{ANY};
+    InflateChunk m_chunk;
+    QSemaphore m_done;
+};
+
+//Writes decompressed data, computes check value and keeps window.
+class InflateOutput
+{
+public:
+    InflateOutput(QIODevice *dest, ZCompressor::CompressFormat format, const ZHashers &hashers)
+        : m_dest(dest), m_format(format), m_hashers(hashers),
+          m_check(format == ZCompressor::ZlibFormat ? 1 : 0)
+    {
+
+    }
+
+    bool write(const char *data, qint64 length)
+    {
+        if (length <= 0)
+            return true;
+
+        if (m_format == ZCompressor::GzipFormat)
+            m_check = Crc32::update(m_check, data, length);
+        else if (m_format == ZCompressor::ZlibFormat)
+            m_check = static_cast<quint32>(adler32(m_check, reinterpret_cast<const Bytef*>(data),
+                                                   static_cast<uInt>(length)));
+
+        addHashData(m_hashers, data, length);
+        m_size += length;
+
+        if (length >= WINDOW)
+            m_window = QByteArray(data + length - WINDOW, WINDOW);
+        else
+        {
+            m_window.append(data, static_cast<int>(length));
+            if (m_window.size() > WINDOW)
+                m_window.remove(0, m_window.size() - WINDOW);
+        }
+
+        return m_dest->write(data, length) == length;
+    }
+
+    const QByteArray& window() const noexcept
+    {
+        return m_window;
+    }
+
+    quint32 check() const noexcept
+    {
+        return m_check;
+    }
+
+    qint64 size() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    QIODevice *m_dest;
+    ZCompressor::CompressFormat m_format;
+    const ZHashers &m_hashers;
+    quint32 m_check;
+    qint64 m_size{0};
+    QByteArray m_window;
+};
+
+//Inflates by zlib from start bit to first block ending at or after stop bit with real window.
+static int inflateChunk(const unsigned char *data, qint64 size, qint64 start, qint64 stop,
+                        InflateOutput &output, qint64 &end, bool &last)
+{
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    strm.avail_in = 0;
+    strm.next_in = reinterpret_cast<decltype(strm.next_in)>(Z_NULL);
+    int ret = inflateInit2(&strm, -MAX_WBITS);
+    if (ret != Z_OK)
+        return ret;
+
+    const QByteArray &window = output.window();
+    if (!window.isEmpty())
+        inflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(window.constData()),
+                             static_cast<uInt>(window.size()));
+
+    //Rest of partial byte.
+    qint64 in = start >> 3;
+    const int bit = static_cast<int>(start & 7);
+    if (bit)
+    {
+        inflatePrime(&strm, 8 - bit, data[in] >> bit);
+        ++in;
+    }
+
+    QByteArray out(256 * 1024, Qt::Uninitialized);
+    for (;;)
+    {
+        if (strm.avail_in == 0)
+        {
+            if (in >= size)
+            {
+                ret = Z_DATA_ERROR;
+                break;
+            }
+
+            const qint64 avail = qMin<qint64>(size - in, 1 << 30);
+            strm.next_in = const_cast<unsigned char*>(data + in);
+            strm.avail_in = static_cast<uInt>(avail);
+            in += avail;
+        }
+
+        strm.next_out = reinterpret_cast<unsigned char*>(out.data());
+        strm.avail_out = static_cast<uInt>(out.size());
+
+        //Returns at end of every block.
+        ret = inflate(&strm, Z_BLOCK);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            if (ret != Z_MEM_ERROR)
+                ret = Z_DATA_ERROR;
+            break;
+        }
+
+        if (!output.write(out.constData(), out.size() - strm.avail_out))
+        {
+            ret = Z_ERRNO;
+            break;
+        }
+
+        if (ret == Z_STREAM_END || (strm.data_type & 128))
+        {
+            end = (in - strm.avail_in) * 8 - (strm.data_type & 7);
+            //Last block may end before stream end is returned.
+            last = ret == Z_STREAM_END || (strm.data_type & 64);
+            if (last || end >= stop)
+            {
+                ret = Z_OK;
+                break;
+            }
+        }
+    }
+
+    inflateEnd(&strm);
+    return ret;
+}
+
+//Size of zlib or gzip header, -1 if not supported (preset dictionary) or invalid.
+static qint64 headerSize(const unsigned char *data, qint64 size, ZCompressor::CompressFormat format)
+{
+    if (format == ZCompressor::RawDeflateFormat)
+        return 0;
+
+    if (format == ZCompressor::ZlibFormat)
+    {
+        if (size < 2 || (data[0] & 0x0f) != 8 || (data[1] & 0x20) || (data[0] * 256 + data[1]) % 31)
+            return -1;
+
+        return 2;
+    }
+
+    //ID1, ID2, CM, FLG, MTIME, XFL, OS and optional fields by flags.
+    if (size < 10 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 || (data[3] & 0xe0))
+        return -1;
+
+    const int flags = data[3];
+    qint64 pos = 10;
+    if (flags & 4)
+    {
+        if (pos + 2 > size)
+            return -1;
+
+        pos += 2 + qFromLittleEndian<quint16>(data + pos);
+    }
+
+    for (int flag = 8; flag <= 16; flag <<= 1)
+    {
+        if (flags & flag)
+        {
+            while (pos < size && data[pos])
+                ++pos;
+
+            ++pos;
+        }
+    }
+
+    if (flags & 2)
+        pos += 2;
+
+    return pos < size ? pos : -1;
+}
+
+//static.
+int ParallelInflate::inf(QIODevice *src, QIODevice *dest, ZCompressor::CompressFormat format,
+                         int threads, const ZHashers &hashers)
+{
+    const ZCompressor::Options serial = threads > 1 ? ZCompressor::PipelineOption
+                                                    : ZCompressor::NoOptions;
+    if (threads < 2 || format == ZCompressor::BlockedGzipFormat || src->isSequential())
+        return ZCompressor::inf(src, dest, format, serial, hashers);
+
+    //Whole stream is mapped.
+    qint64 size = src->size() - src->pos();
+    FileMapper mapper(src, qMax<qint64>(size, 1));
+    if (!mapper.isValid() || !mapper.next() || mapper.size() < CHUNK * 2)
+        return ZCompressor::inf(src, dest, format, serial, hashers);
+
+    const unsigned char *data = mapper.data();
+    size = mapper.size();
+    const qint64 offset = headerSize(data, size, format);
+    if (offset < 0)
+        return ZCompressor::inf(src, dest, format, serial, hashers);
+
+    //Chunk i starts at byte offset + i * CHUNK, ends at first block boundary after next chunk start.
+    const int count = static_cast<int>((size - offset + CHUNK - 1) / CHUNK);
+    const auto chunkStart = [offset](int i)
+    {
+        return (offset + i * CHUNK) * 8;
+    };
+    const auto chunkStop = [count, chunkStart](int i)
+    {
+        return i + 1 < count ? chunkStart(i + 1) : std::numeric_limits<qint64>::max();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QVector<ParallelInflateTask*> tasks(count, nullptr);
+    const int ahead = threads * 2;
+    const auto startTask = [&](int i)
+    {
+        if (i < count)
+        {
+            tasks[i] = new ParallelInflateTask(data, size, chunkStart(i), chunkStop(i));
+            pool.start(tasks[i]);
+        }
+    };
+
+    //First chunk is inflated by zlib while next chunks are decoded.
+    for (int i = 1; i <= ahead; ++i)
+        startTask(i);
+
+    InflateOutput output(dest, format, hashers);
+    qint64 end = chunkStart(0);
+    bool last = false;
+    int ret = Z_OK;
+    for (int i = 0; i < count && ret == Z_OK && !last; ++i)
+    {
+        if (i > 0)
+            startTask(i + ahead);
+
+        bool done = end >= chunkStop(i);
+        ParallelInflateTask *task = tasks.at(i);
+        if (task)
+        {
+            if (done)
+                task->cancel();
+            else
+                task->setTarget(end);
+
+            task->wait();
+            InflateChunk &chunk = task->chunk();
+            if (!done && chunk.start == end)
+            {
+                //Window references are resolved by real window.
+                const QByteArray &window = output.window();
+                const int missing = WINDOW - window.size();
+                const quint16 *symbols = chunk.symbols.constData() + WINDOW;
+                char *chunkData = chunk.data.data();
+                bool resolved = true;
+                for (int j = 0; j < chunk.unresolved; ++j)
+                {
+                    const int symbol = symbols[j];
+                    if (symbol > 255)
+                    {
+                        if (symbol - 256 < missing)
+                        {
+                            resolved = false;
+                            break;
+                        }
+
+                        chunkData[j] = window.at(symbol - 256 - missing);
+                    }
+                }
+
+                if (resolved)
+                {
+                    if (!output.write(chunk.data.constData(), chunk.data.size()))
+                        ret = Z_ERRNO;
+
+                    end = chunk.end;
+                    last = chunk.last;
+                    done = true;
+                }
+            }
+
+            delete task;
+            tasks[i] = nullptr;
+        }
+
+        if (!done && ret == Z_OK)
+            ret = inflateChunk(data, size, end, chunkStop(i), output, end, last);
+    }
+
+    //Chunks after end of stream.
+    for (ParallelInflateTask *task : tasks)
+    {
+        if (task)
+            task->cancel();
+    }
+
+    pool.waitForDone();
+    qDeleteAll(tasks);
+
+    if (ret != Z_OK)
+        return ret;
+
+    if (!last)
+        return Z_DATA_ERROR;
+
+    //Trailer from byte boundary: CRC32 and size for gzip, Adler-32 for zlib.
+    qint64 pos = (end + 7) / 8;
+    if (format == ZCompressor::GzipFormat)
+    {
+        if (pos + 8 > size || qFromLittleEndian<quint32>(data + pos) != output.check()
+                || qFromLittleEndian<quint32>(data + pos + 4) != static_cast<quint32>(output.size()))
+            return Z_DATA_ERROR;
+
+        pos += 8;
+    }
+    else if (format == ZCompressor::ZlibFormat)
+    {
+        if (pos + 4 > size || qFromBigEndian<quint32>(data + pos) != output.check())
+            return Z_DATA_ERROR;
+
+        pos += 4;
+    }
+
+    //File position after compressed stream.
+    mapper.seek(pos);
+    return Z_OK;
+}
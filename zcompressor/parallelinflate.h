@@ -0,0 +1,42 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PARALLELINFLATE_H
+#define PARALLELINFLATE_H
+
+#include "zcompressor.h"
+
+class QIODevice;
+
+//Decompresses one deflate stream in several threads (as rapidgzip). Mapped input is split to
+//chunks, first dynamic block after start of every chunk is found by trial decoding and chunk is
+//decoded with unknown window: back references before chunk are markers of window positions. Chunks
+//are resolved in order when previous chunk ends exactly at found block, other chunks are inflated
+//by zlib from real end with real window, so output is same as of serial inflate.
+class ParallelInflate
+{
+public:
+    //Compressed bytes of chunk.
+    constexpr static qint64 CHUNK{1024 * 1024};
+
+    //Not mapped source or small stream is decompressed serially.
+    static int inf(QIODevice *src, QIODevice *dest, ZCompressor::CompressFormat format, int threads,
+                   const ZHashers &hashers);
+};
+
+#endif // PARALLELINFLATE_H
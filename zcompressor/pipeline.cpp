@@ -0,0 +1,173 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "pipeline.h"
+
+#include <QIODevice>
+
+Pipeline::Pipeline(QIODevice *src, QIODevice *dest)
+    : m_src(src), m_dest(dest), m_memory(new unsigned char[COUNT * 2 * BUFFER]),
+      m_reader(this, &Pipeline::read), m_writer(this, &Pipeline::write)
+{
+    for (int i = 0; i < COUNT * 2; ++i)
+    {
+        m_buffers[i].data = m_memory.data() + i * BUFFER;
+        m_buffers[i].size = 0;
+        m_buffers[i].last = false;
+    }
+
+    for (int i = 0; i < COUNT; ++i)
+    {
+        m_freeIn.push(&m_buffers[i]);
+        m_freeOut.push(&m_buffers[COUNT + i]);
+    }
+
+    m_reader.start();
+    m_writer.start();
+}
+
+Pipeline::~Pipeline()
+{
+    //Interrupted without finish.
+    if (m_reader.isRunning() || m_writer.isRunning())
+    {
+        raise(m_failed);
+        raise(m_stop);
+        m_reader.wait();
+        m_writer.wait();
+    }
+}
+
+PipelineBuffer* Pipeline::takeInput()
+{
+    return take(m_fullIn);
+}
+
+void Pipeline::recycleInput(PipelineBuffer *buffer)
+{
+    put(m_freeIn, buffer);
+}
+
+PipelineBuffer* Pipeline::takeOutput()
+{
+    PipelineBuffer *buffer = take(m_freeOut);
+    if (buffer)
+    {
+        buffer->size = 0;
+        buffer->last = false;
+    }
+
+    return buffer;
+}
+
+void Pipeline::putOutput(PipelineBuffer *buffer)
+{
+    put(m_fullOut, buffer);
+}
+
+bool Pipeline::finish()
+{
+    raise(m_stop);
+    m_reader.wait();
+    m_writer.wait();
+
+    return !m_failed.loadAcquire();
+}
+
+void Pipeline::read()
+{
+    PipelineBuffer *buffer;
+    do
+    {
+        buffer = take(m_freeIn, true);
+        if (!buffer)
+            return;
+
+        buffer->size = m_src->read(reinterpret_cast<char*>(buffer->data), BUFFER);
+        if (buffer->size < 0)
+        {
+            raise(m_failed);
+            return;
+        }
+
+        buffer->last = buffer->size == 0;
+        put(m_fullIn, buffer);
+    }
+    while (!buffer->last);
+}
+
+void Pipeline::write()
+{
+    PipelineBuffer *buffer;
+    do
+    {
+        buffer = take(m_fullOut);
+        if (!buffer)
+            return;
+
+        if (m_dest->write(reinterpret_cast<char*>(buffer->data), buffer->size) != buffer->size)
+        {
+            raise(m_failed);
+            return;
+        }
+
+        put(m_freeOut, buffer);
+    }
+    while (!buffer->last);
+}
+
+PipelineBuffer* Pipeline::take(Queue &queue, bool reader)
+{
+    PipelineBuffer *buffer;
+    //Short wait for other thread, then blocks while device is slow.
+    for (int spin = 0; spin < 16; ++spin)
+    {
+        if (queue.pop(buffer))
+            return buffer;
+
+        if (m_failed.loadAcquire() || (reader && m_stop.loadAcquire()))
+            return nullptr;
+
+        QThread::yieldCurrentThread();
+    }
+
+    //Pushing thread takes mutex after push, so wake isn't lost between pop and wait.
+    QMutexLocker locker(&m_mutex);
+    while (!queue.pop(buffer))
+    {
+        if (m_failed.loadAcquire() || (reader && m_stop.loadAcquire()))
+            return nullptr;
+
+        m_wake.wait(&m_mutex);
+    }
+
+    return buffer;
+}
+
+void Pipeline::put(Queue &queue, PipelineBuffer *buffer)
+{
+    queue.push(buffer);
+    QMutexLocker locker(&m_mutex);
+    m_wake.wakeAll();
+}
+
+void Pipeline::raise(QAtomicInt &flag)
+{
+    flag.storeRelease(1);
+    QMutexLocker locker(&m_mutex);
+    m_wake.wakeAll();
+}
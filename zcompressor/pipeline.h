@@ -0,0 +1,149 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QAtomicInt>
+#include <QScopedPointer>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QIODevice;
+
+//Bounded lock-free queue for one producer and one consumer thread.
+template<typename T, int N>
+class SpscQueue
+{
+public:
+    bool push(const T &value)
+    {
+        const int tail = m_tail.loadAcquire();
+        const int next = (tail + 1) % N;
+        if (next == m_head.loadAcquire())
+            return false;
+
+        m_items[tail] = value;
+        m_tail.storeRelease(next);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        const int head = m_head.loadAcquire();
+        if (head == m_tail.loadAcquire())
+            return false;
+
+        value = m_items[head];
+        m_head.storeRelease((head + 1) % N);
+        return true;
+    }
+
+private:
+    T m_items[N];
+    QAtomicInt m_head{0};
+    QAtomicInt m_tail{0};
+};
+
+struct PipelineBuffer
+{
+    unsigned char *data;
+    qint64 size;
+    //Last input buffer is empty (end of source), last output buffer ends writing.
+    bool last;
+};
+
+//Reads source and writes destination in own threads, buffers are recycled between threads.
+//Devices should not be used by other threads until finish().
+class Pipeline
+{
+public:
+    constexpr static qint64 BUFFER{256 * 1024};
+
+    Pipeline(QIODevice *src, QIODevice *dest);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    //Filled input buffer, nullptr if failed.
+    PipelineBuffer* takeInput();
+    void recycleInput(PipelineBuffer *buffer);
+
+    //Empty output buffer, nullptr if failed.
+    PipelineBuffer* takeOutput();
+    void putOutput(PipelineBuffer *buffer);
+
+    //Stops reading and waits end of writing (output buffer marked last), false if device failed.
+    bool finish();
+
+private:
+    class Thread : public QThread
+    {
+    public:
+        Thread(Pipeline *pipeline, void (Pipeline::*func)())
+            : m_pipeline(pipeline), m_func(func)
+        {
+
+        }
+
+    protected:
+        void run() override
+        {
+            (m_pipeline->*m_func)();
+        }
+
+    private:
+        Pipeline *m_pipeline;
+        void (Pipeline::*m_func)();
+    };
+
+    constexpr static int COUNT{4};
+    typedef SpscQueue<PipelineBuffer*, COUNT + 1> Queue;
+
+    void read();
+    void write();
+    //Waits buffer, nullptr if failed (or stopped for reader).
+    PipelineBuffer* take(Queue &queue, bool reader = false);
+    //Pushes buffer and wakes waiting thread.
+    void put(Queue &queue, PipelineBuffer *buffer);
+    //Sets flag (stop or failed) and wakes waiting threads.
+    void raise(QAtomicInt &flag);
+
+    QIODevice *m_src;
+    QIODevice *m_dest;
+
+    QScopedArrayPointer<unsigned char> m_memory;
+    PipelineBuffer m_buffers[COUNT * 2];
+    Queue m_freeIn;
+    Queue m_fullIn;
+    Queue m_freeOut;
+    Queue m_fullOut;
+
+    QAtomicInt m_stop{0};
+    QAtomicInt m_failed{0};
+
+    //Threads block here after short spin, queues stay lock-free.
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+
+    Thread m_reader;
+    Thread m_writer;
+};
+
+#endif // PIPELINE_H
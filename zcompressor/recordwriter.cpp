@@ -0,0 +1,238 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "recordwriter.h"
+
+#include <QIODevice>
+#include <QDataStream>
+
+#include <algorithm>
+
+int RecordIndex::block(int record) const
+{
+    const auto it = std::upper_bound(m_blocks.constBegin(), m_blocks.constEnd(), record,
+                                     [](int value, const QPair<quint64, int> &block)
+    {
+        return value < block.second;
+    });
+
+    return static_cast<int>(it - m_blocks.constBegin()) - 1;
+}
+
+void RecordIndex::appendBlock(quint64 compressedOffset)
+{
+    m_blocks.append(qMakePair(compressedOffset, size()));
+}
+
+void RecordIndex::append(quint32 size)
+{
+    //First record of block starts at 0.
+    quint32 offset = 0;
+    if (!m_sizes.isEmpty() && m_blocks.last().second < m_sizes.size())
+        offset = m_offsets.last() + m_sizes.last();
+
+    m_sizes.append(size);
+    m_offsets.append(offset);
+}
+
+bool RecordIndex::load(QIODevice *device)
+{
+    clear();
+
+    QDataStream strm(device);
+    strm.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 blocks, records;
+    strm >> blocks >> records;
+    for (quint32 i = 0; i < blocks && strm.status() == QDataStream::Ok; ++i)
+    {
+        quint64 offset;
+        quint32 first;
+        strm >> offset >> first;
+        m_blocks.append(qMakePair(offset, static_cast<int>(first)));
+    }
+
+    //Offsets of records are restored from sizes.
+    int block = 0;
+    for (quint32 i = 0; i < records && strm.status() == QDataStream::Ok; ++i)
+    {
+        quint32 size;
+        strm >> size;
+        while (block + 1 < m_blocks.size() && m_blocks.at(block + 1).second <= static_cast<int>(i))
+            ++block;
+
+        m_offsets.append(m_blocks.isEmpty() || m_blocks.at(block).second == static_cast<int>(i)
+                         ? 0 : m_offsets.last() + m_sizes.last());
+        m_sizes.append(size);
+    }
+
+    if (strm.status() != QDataStream::Ok)
+    {
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool RecordIndex::save(QIODevice *device) const
+{
+    QDataStream strm(device);
+    strm.setByteOrder(QDataStream::LittleEndian);
+
+    strm << static_cast<quint32>(m_blocks.size()) << static_cast<quint32>(m_sizes.size());
+    for (const auto &block : m_blocks)
+        strm << block.first << static_cast<quint32>(block.second);
+
+    for (const auto size : m_sizes)
+        strm << size;
+
+    return strm.status() == QDataStream::Ok;
+}
+
+QByteArray RecordIndex::read(QIODevice *device, int record, qint64 frameOffset) const
+{
+    QByteArray result;
+    const int blk = record >= 0 && record < size() ? block(record) : -1;
+    if (blk < 0
+            || !device->seek(frameOffset + static_cast<qint64>(compressedOffset(blk))))
+        return result;
+
+    //Block is decompressed to end of record.
+    const quint32 end = offset(record) + recordSize(record);
+    QByteArray out(static_cast<int>(end), Qt::Uninitialized);
+    QByteArray in(16384, Qt::Uninitialized);
+
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    strm.avail_in = 0;
+    strm.next_in = reinterpret_cast<decltype(strm.next_in)>(Z_NULL);
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+        return result;
+
+    strm.avail_out = end;
+    strm.next_out = reinterpret_cast<unsigned char*>(out.data());
+    int ret = Z_OK;
+    while (strm.avail_out > 0 && ret == Z_OK)
+    {
+        const qint64 avail = device->read(in.data(), in.size());
+        if (avail <= 0)
+            break;
+
+        strm.avail_in = static_cast<uInt>(avail);
+        strm.next_in = reinterpret_cast<unsigned char*>(in.data());
+        ret = inflate(&strm, Z_NO_FLUSH);
+    }
+
+    const bool ok = strm.avail_out == 0 && (ret == Z_OK || ret == Z_STREAM_END);
+    inflateEnd(&strm);
+    if (ok)
+        result = out.mid(static_cast<int>(offset(record)));
+
+    return result;
+}
+
+RecordWriter::RecordWriter(QIODevice *device, int level, int blockSize)
+    : m_device(device), m_blockSize(blockSize), m_buffer(CHUNK, Qt::Uninitialized)
+{
+    m_strm.zalloc = reinterpret_cast<decltype(m_strm.zalloc)>(Z_NULL);
+    m_strm.zfree = reinterpret_cast<decltype(m_strm.zfree)>(Z_NULL);
+    m_strm.opaque = reinterpret_cast<decltype(m_strm.opaque)>(Z_NULL);
+    m_active = deflateInit2(&m_strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)
+            == Z_OK;
+}
+
+RecordWriter::~RecordWriter()
+{
+    if (m_active)
+        deflateEnd(&m_strm);
+}
+
+bool RecordWriter::write(const QByteArray &record)
+{
+    if (!m_active)
+        return false;
+
+    //Restart point before first record of block.
+    if (m_blockFill == 0)
+        m_index.appendBlock(m_size);
+
+    m_index.append(static_cast<quint32>(record.size()));
+    m_blockFill += record.size();
+
+    //Full block ends by full flush, next block doesn't refer to it.
+    const bool end = m_blockFill >= m_blockSize;
+    if (end)
+        m_blockFill = 0;
+
+    return def(reinterpret_cast<const unsigned char*>(record.constData()), record.size(),
+               end ? Z_FULL_FLUSH : Z_NO_FLUSH);
+}
+
+bool RecordWriter::write(const QVector<QByteArray> &records)
+{
+    for (const auto &record : records)
+    {
+        if (!write(record))
+            return false;
+    }
+
+    return true;
+}
+
+bool RecordWriter::finish()
+{
+    if (!m_active)
+        return false;
+
+    const bool ok = def(reinterpret_cast<const unsigned char*>(0), 0, Z_FINISH);
+    deflateEnd(&m_strm);
+    m_active = false;
+
+    return ok;
+}
+
+bool RecordWriter::def(const unsigned char *data, int length, int flush)
+{
+    m_strm.avail_in = static_cast<uInt>(length);
+    m_strm.next_in = const_cast<unsigned char*>(data);
+
+    do
+    {
+        m_strm.avail_out = CHUNK;
+        m_strm.next_out = reinterpret_cast<unsigned char*>(m_buffer.data());
+
+        const int ret = deflate(&m_strm, flush);
+        Q_ASSERT(ret != Z_STREAM_ERROR);
+        Q_UNUSED(ret)
+
+        const qint64 have = CHUNK - m_strm.avail_out;
+        if (m_device->write(m_buffer.constData(), have) != have)
+        {
+            deflateEnd(&m_strm);
+            m_active = false;
+            return false;
+        }
+
+        m_size += static_cast<quint64>(have);
+    }
+    while (m_strm.avail_out == 0);
+
+    return true;
+}
@@ -0,0 +1,133 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECORDWRITER_H
+#define RECORDWRITER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include <zlib.h>
+
+class QIODevice;
+
+//Index of records in frame: blocks (restart points) with compressed offset and first record,
+//records with size and offset in uncompressed block. Offsets are relative to start of frame.
+class RecordIndex
+{
+public:
+    void clear()
+    {
+        m_blocks.clear();
+        m_sizes.clear();
+        m_offsets.clear();
+    }
+
+    //Number of records.
+    int size() const
+    {
+        return m_sizes.size();
+    }
+
+    int blockCount() const
+    {
+        return m_blocks.size();
+    }
+
+    quint64 compressedOffset(int block) const
+    {
+        return m_blocks.at(block).first;
+    }
+
+    quint32 recordSize(int record) const
+    {
+        return m_sizes.at(record);
+    }
+
+    //Offset of record in uncompressed block.
+    quint32 offset(int record) const
+    {
+        return m_offsets.at(record);
+    }
+
+    //Block containing record.
+    int block(int record) const;
+
+    //New block starts from next record.
+    void appendBlock(quint64 compressedOffset);
+    //Record is appended to last block.
+    void append(quint32 size);
+
+    //Compact form: blocks (offset, first record) and sizes of records.
+    bool load(QIODevice *device);
+    bool save(QIODevice *device) const;
+
+    //Reads record from frame, only block of record is decompressed. Frame starts at frameOffset
+    //of device. Null array on error.
+    QByteArray read(QIODevice *device, int record, qint64 frameOffset = 0) const;
+
+private:
+    QVector<QPair<quint64, int>> m_blocks;
+    QVector<quint32> m_sizes;
+    QVector<quint32> m_offsets;
+};
+
+//Compresses many small records to one raw deflate frame. Compressor is fully flushed when block
+//reaches blockSize (after record), so every block is decompressed without previous data.
+class RecordWriter
+{
+public:
+    explicit RecordWriter(QIODevice *device, int level = Z_DEFAULT_COMPRESSION,
+                          int blockSize = 64 * 1024);
+    ~RecordWriter();
+
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+
+    bool write(const QByteArray &record);
+    bool write(const QVector<QByteArray> &records);
+    //Ends frame, no records may be written after.
+    bool finish();
+
+    const RecordIndex& index() const noexcept
+    {
+        return m_index;
+    }
+
+    //Compressed size of frame so far.
+    quint64 size() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    constexpr static int CHUNK{16384};
+
+    bool def(const unsigned char *data, int length, int flush);
+
+    QIODevice *m_device;
+    z_stream m_strm;
+    bool m_active{false};
+    int m_blockSize;
+    //Uncompressed size of current block.
+    int m_blockFill{0};
+    quint64 m_size{0};
+    RecordIndex m_index;
+    QByteArray m_buffer;
+};
+
+#endif // RECORDWRITER_H
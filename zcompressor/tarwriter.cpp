@@ -0,0 +1,245 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "tarwriter.h"
+
+#include <QIODevice>
+
+#include <cstring>
+
+//Max value of 11 octal digits.
+static const qint64 MAX_OCTAL = 077777777777LL;
+
+TarWriter::TarWriter(QIODevice *device, int level)
+    : m_cmprs(device)
+{
+    m_cmprs.setCompressFormat(ZCompressor::GzipFormat);
+    m_cmprs.setCompressLevel(level);
+    m_cmprs.open(QIODevice::WriteOnly);
+}
+
+bool TarWriter::writeFile(const QString &name, const QByteArray &bytes, const QDateTime &modified)
+{
+    return writeStartFile(name, bytes.size(), modified) && writeBytes(bytes) && writeEndFile();
+}
+
+bool TarWriter::writeFile(const QString &name, QIODevice *device, qint64 size,
+                          const QDateTime &modified)
+{
+    if (size < 0 && !device->isSequential())
+        size = device->size() - device->pos();
+
+    //Unknown size, data is buffered until end of device. Byte past limit means device is longer.
+    if (size < 0)
+    {
+        QByteArray bytes;
+        for (;;)
+        {
+            const qint64 left = m_bufferLimit + 1 - bytes.size();
+            if (left <= 0)
+            {
+                m_errorString = QStringLiteral("input exceeds buffer limit");
+                return false;
+            }
+
+            const QByteArray part = device->read(qMin<qint64>(left, 1024 * 1024));
+            if (!part.isEmpty())
+                bytes.append(part);
+            else if (!device->waitForReadyRead(-1))
+                break;
+        }
+
+        return writeFile(name, bytes, modified);
+    }
+
+    if (!writeStartFile(name, size, modified))
+        return false;
+
+    while (m_written < size)
+    {
+        const QByteArray bytes = device->read(qMin<qint64>(size - m_written, 1024 * 1024));
+        if (bytes.isEmpty() && !(device->isSequential() && device->waitForReadyRead(-1)))
+        {
+            if (!fillFile())
+                return false;
+
+            m_errorString = QStringLiteral("input ended before size of file");
+            return false;
+        }
+
+        if (!writeBytes(bytes))
+            return false;
+    }
+
+    return writeEndFile();
+}
+
+bool TarWriter::writeStartFile(const QString &name, qint64 size, const QDateTime &modified)
+{
+    if (!m_cmprs.isOpen() || m_size >= 0 || size < 0)
+        return false;
+
+    const QByteArray path = name.toUtf8();
+    const QDateTime time = modified.isValid() ? modified : QDateTime::currentDateTime();
+    const qint64 mtime = qBound<qint64>(0, time.toMSecsSinceEpoch() / 1000, MAX_OCTAL);
+
+    //Long path is split to prefix and name at slash if possible.
+    QByteArray fileName = path;
+    QByteArray prefix;
+    if (path.size() > 100)
+    {
+        const int slash = path.lastIndexOf('/', 155);
+        if (slash > 0 && path.size() - slash - 1 <= 100 && slash < path.size() - 1)
+        {
+            prefix = path.left(slash);
+            fileName = path.mid(slash + 1);
+        }
+    }
+
+    //Pax header for path and size which don't fit in ustar fields.
+    QByteArray pax;
+    if (fileName.size() > 100)
+    {
+        pax += paxRecord("path", path);
+        fileName = path.right(100);
+    }
+
+    if (size > MAX_OCTAL)
+        pax += paxRecord("size", QByteArray::number(size));
+
+    if (!pax.isEmpty())
+    {
+        if (!write(header("././@PaxHeader", QByteArray(), pax.size(), mtime, 'x')) || !write(pax)
+                || !pad(pax.size()))
+            return false;
+    }
+
+    if (!write(header(fileName, prefix, size > MAX_OCTAL ? 0 : size, mtime, '0')))
+        return false;
+
+    m_size = size;
+    m_written = 0;
+    return true;
+}
+
+bool TarWriter::writeBytes(const QByteArray &bytes)
+{
+    if (m_size < 0 || m_written + bytes.size() > m_size || !write(bytes))
+        return false;
+
+    m_written += bytes.size();
+    return true;
+}
+
+bool TarWriter::writeEndFile()
+{
+    if (m_size < 0 || m_written != m_size)
+        return false;
+
+    m_size = -1;
+    return pad(m_written);
+}
+
+bool TarWriter::finish()
+{
+    if (!m_cmprs.isOpen() || m_size >= 0)
+        return false;
+
+    const bool ok = write(QByteArray(BLOCK * 2, '\0'));
+    m_cmprs.close();
+    return ok && m_cmprs.state() == Z_STREAM_END;
+}
+
+//static.
+QByteArray TarWriter::header(const QByteArray &name, const QByteArray &prefix, qint64 size,
+                             qint64 mtime, char type)
+{
+    QByteArray result(BLOCK, '\0');
+    char *data = result.data();
+    memcpy(data, name.constData(), static_cast<size_t>(qMin(name.size(), 100)));
+    //Mode, uid, gid.
+    octal(data + 100, 8, 0644);
+    octal(data + 108, 8, 0);
+    octal(data + 116, 8, 0);
+    octal(data + 124, 12, size);
+    octal(data + 136, 12, mtime);
+    data[156] = type;
+    memcpy(data + 257, "ustar\0" "00", 8);
+    memcpy(data + 345, prefix.constData(), static_cast<size_t>(qMin(prefix.size(), 155)));
+
+    //Checksum is computed with spaces in its field.
+    memset(data + 148, ' ', 8);
+    unsigned sum = 0;
+    for (int i = 0; i < BLOCK; ++i)
+        sum += static_cast<unsigned char>(data[i]);
+
+    octal(data + 148, 7, sum);
+    return result;
+}
+
+//static.
+QByteArray TarWriter::paxRecord(const char *key, const QByteArray &value)
+{
+    const QByteArray record = ' ' + QByteArray(key) + '=' + value + '\n';
+    //Length of record depends on digits of length.
+    int length = record.size() + 1;
+    while (QByteArray::number(length).size() + record.size() != length)
+        ++length;
+
+    return QByteArray::number(length) + record;
+}
+
+//static.
+void TarWriter::octal(char *field, int size, qint64 value)
+{
+    //Zero padded digits and terminating null.
+    field[size - 1] = '\0';
+    for (int i = size - 2; i >= 0; --i)
+    {
+        field[i] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+bool TarWriter::write(const QByteArray &bytes)
+{
+    if (m_cmprs.write(bytes) == bytes.size())
+        return true;
+
+    m_errorString = QStringLiteral("error writing archive");
+    return false;
+}
+
+bool TarWriter::pad(qint64 size)
+{
+    const int rest = static_cast<int>(size % BLOCK);
+    return rest == 0 || write(QByteArray(BLOCK - rest, '\0'));
+}
+
+bool TarWriter::fillFile()
+{
+    const QByteArray zeros(static_cast<int>(qMin<qint64>(m_size - m_written, 1024 * 1024)), '\0');
+    while (m_written < m_size)
+    {
+        if (!writeBytes(zeros.left(static_cast<int>(qMin<qint64>(m_size - m_written,
+                                                                  zeros.size())))))
+            return false;
+    }
+
+    return writeEndFile();
+}
@@ -0,0 +1,101 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TARWRITER_H
+#define TARWRITER_H
+
+#include "zcompressor.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+class QIODevice;
+
+//Writes tar archive (ustar, pax headers for long names and large files) through gzip compressor,
+//device may be sequential (socket, pipe). Archive is ended by finish().
+class TarWriter
+{
+public:
+    constexpr static int BLOCK{512};
+
+    explicit TarWriter(QIODevice *device, int level = Z_DEFAULT_COMPRESSION);
+
+    TarWriter(const TarWriter&) = delete;
+    TarWriter& operator=(const TarWriter&) = delete;
+
+    //Modification time of file is current time if not valid.
+    bool writeFile(const QString &name, const QByteArray &bytes,
+                   const QDateTime &modified = QDateTime());
+    //Reads size bytes of device. If size is -1, device is read to end: size of random access
+    //device is known, sequential device is read to memory (tar header precedes data) up to
+    //bufferLimit. Longer data fails, read input is consumed and lost and nothing is written. If
+    //device ends before size, file is filled with zeros (archive stays valid) and false is returned.
+    bool writeFile(const QString &name, QIODevice *device, qint64 size = -1,
+                   const QDateTime &modified = QDateTime());
+
+    //Writes header of file, exactly size bytes must be written before writeEndFile.
+    bool writeStartFile(const QString &name, qint64 size,
+                        const QDateTime &modified = QDateTime());
+    bool writeBytes(const QByteArray &bytes);
+    bool writeEndFile();
+
+    //Writes end of archive (two empty blocks) and gzip trailer.
+    bool finish();
+
+    //Max size of sequential device data of unknown size (default 64 MiB, less than 2 GiB).
+    void setBufferLimit(qint64 limit) noexcept
+    {
+        m_bufferLimit = qBound<qint64>(0, limit, MAX_BUFFER);
+    }
+
+    qint64 bufferLimit() const noexcept
+    {
+        return m_bufferLimit;
+    }
+
+    //Reason of last failure.
+    QString errorString() const
+    {
+        return m_errorString;
+    }
+
+    constexpr static qint64 MAX_BUFFER{0x7fffffff - 1024 * 1024};
+
+private:
+    //Header block, name is already split to prefix or is replaced by pax header.
+    static QByteArray header(const QByteArray &name, const QByteArray &prefix, qint64 size,
+                             qint64 mtime, char type);
+    //Pax record "length key=value\n", length includes itself.
+    static QByteArray paxRecord(const char *key, const QByteArray &value);
+    static void octal(char *field, int size, qint64 value);
+
+    bool write(const QByteArray &bytes);
+    bool pad(qint64 size);
+    //Fills rest of current file with zeros and ends it.
+    bool fillFile();
+
+    ZCompressor m_cmprs;
+    //Size of current file and written bytes, size is -1 without file.
+    qint64 m_size{-1};
+    qint64 m_written{0};
+    qint64 m_bufferLimit{64 * 1024 * 1024};
+    QString m_errorString;
+};
+
+#endif // TARWRITER_H
@@ -16,15 +16,76 @@
 */
 
 #include "zcompressor.h"
+#include "filemapper.h"
+#include "pipeline.h"
+#include "paralleldeflate.h"
+#include "parallelinflate.h"
+#include "deltadeflate.h"
+#include "crc32simd.h"
+
+#include <QBuffer>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QtEndian>
+
+#include <limits>
+
+//Input measured before adaptive level is changed.
+constexpr static qint64 ADAPT_WINDOW{1024 * 1024};
+
+//Rolling hash of last bytes (as pigz --rsyncable), boundary in average every 4 KiB of input.
+constexpr static unsigned RSYNC_MASK{(1u << 12) - 1};
+constexpr static unsigned RSYNC_HIT{RSYNC_MASK >> 1};
+
+//Length of data to boundary (inclusive) or length if boundary not found.
+static qint64 rsyncBoundary(unsigned &hash, const unsigned char *data, qint64 length, bool &found)
+{
+    for (qint64 i = 0; i < length; ++i)
+    {
+        hash = ((hash << 1) ^ data[i]) & RSYNC_MASK;
+        if (hash == RSYNC_HIT)
+        {
+            found = true;
+            return i + 1;
+        }
+    }
+
+    found = false;
+    return length;
+}
 
 bool ZCompressor::open(QIODevice::OpenMode mode)
 {
     if (!isOpen() && m_device && m_device->isOpen())
     {
+        m_strm.total_in = 0;
+        m_strm.total_out = 0;
+        m_totalIn = 0;
+        m_totalOut = 0;
+        m_streamIn = 0;
+        m_streamOut = 0;
+        m_rsync = 0;
+        m_end = false;
+        m_active = false;
+        m_currentLevel = m_level == Z_DEFAULT_COMPRESSION ? 6 : m_level;
+        m_adaptBytes = 0;
+        m_adaptNsecs = 0;
+        m_adaptWrites = 0;
+        m_resumed = false;
+        m_written = 0;
+        m_readBuffer.clear();
+        m_readPos = 0;
+        m_readPending = false;
+        m_boundary = false;
+        m_eof = false;
+        m_index.clear();
+
+        //Stream state is initialized on first read or write.
         if (mode & QIODevice::WriteOnly)
-            m_state = defInit(&m_strm, m_level, m_format);
+            m_state = m_level >= Z_DEFAULT_COMPRESSION && m_level <= Z_BEST_COMPRESSION
+                    ? Z_OK : Z_STREAM_ERROR;
         else if (mode & QIODevice::ReadOnly)
-            m_state = infInit(&m_strm, m_format);
+            m_state = Z_OK;
         else
             m_state = Z_ERRNO;
 
@@ -42,16 +103,154 @@ void ZCompressor::close()
         if (openMode() & QIODevice::WriteOnly)
         {
             QIODevice::close();
-            if (!m_end)
-                m_state = def(reinterpret_cast<unsigned char*>(0), 0, Z_FINISH);
-            deflateEnd(&m_strm);
+            if (!m_end && (m_state = activate()) == Z_OK)
+            {
+                if (m_format == BlockedGzipFormat)
+                    m_state = defEndBlocks();
+                else
+                {
+                    m_state = def(reinterpret_cast<unsigned char*>(0), 0, Z_FINISH);
+                    if (m_resumed && m_state == Z_STREAM_END)
+                        m_state = defTrailer();
+                }
+            }
+
+            if (m_active)
+                deflateEnd(&m_strm);
         }
         else
         {
             QIODevice::close();
-            inflateEnd(&m_strm);
+            if (m_active)
+                inflateEnd(&m_strm);
+        }
+
+        m_active = false;
+    }
+}
+
+int ZCompressor::activate()
+{
+    if (m_active)
+        return Z_OK;
+
+    int ret;
+    if (openMode() & QIODevice::WriteOnly)
+        ret = defInit(&m_strm, m_currentLevel, m_format, m_resumed);
+    else
+        ret = infInit(&m_strm, m_format);
+
+    m_active = ret == Z_OK;
+    return ret;
+}
+
+void ZCompressor::countTotals()
+{
+    //Difference of unsigned long is right after wrap around.
+    m_totalIn += static_cast<uLong>(m_strm.total_in - m_streamIn);
+    m_totalOut += static_cast<uLong>(m_strm.total_out - m_streamOut);
+    m_streamIn = m_strm.total_in;
+    m_streamOut = m_strm.total_out;
+}
+
+void ZCompressor::resetTotals()
+{
+    m_strm.total_in = 0;
+    m_strm.total_out = 0;
+    m_streamIn = 0;
+    m_streamOut = 0;
+}
+
+unsigned char* ZCompressor::buffer()
+{
+    if (!m_buffer)
+        m_buffer.reset(reinterpret_cast<unsigned char*>(malloc(CHUNK)));
+
+    return m_buffer.data();
+}
+
+bool ZCompressor::hibernate()
+{
+    if (!isOpen() || m_end)
+        return false;
+
+    if (openMode() & QIODevice::WriteOnly)
+    {
+        if (m_active)
+        {
+            if (m_format == BlockedGzipFormat)
+            {
+                //Rest of data is written as smaller block.
+                if (!m_block.isEmpty())
+                    m_state = defBlock(reinterpret_cast<const unsigned char*>(m_block.constData()),
+                                       m_block.size());
+                m_block = QByteArray();
+                m_blockBuffer.reset();
+            }
+            else
+            {
+                //After full flush next data doesn't refer to previous, stream continues as raw
+                //deflate. Check value of data so far is kept from stream.
+                m_state = def(reinterpret_cast<unsigned char*>(0), 0, Z_FULL_FLUSH);
+                if (!m_resumed)
+                    m_check = m_strm.adler;
+                m_resumed = true;
+            }
+
+            if (m_state != Z_OK)
+            {
+                m_end = true;
+                return false;
+            }
+
+            countTotals();
+            deflateEnd(&m_strm);
+            resetTotals();
+            m_active = false;
         }
+
+        m_buffer.reset();
+    }
+    else
+    {
+        if (m_readPos == m_readBuffer.size())
+        {
+            m_readBuffer = QByteArray();
+            m_readPos = 0;
+        }
+
+        if (!m_active || m_strm.avail_in == 0)
+            m_buffer.reset();
+    }
+
+    return true;
+}
+
+int ZCompressor::defTrailer()
+{
+    //Trailer of resumed raw stream: Adler-32 (big endian) or CRC-32 and size (little endian).
+    uchar trailer[8];
+    int size = 0;
+    if (m_format == ZlibFormat)
+    {
+        qToBigEndian<quint32>(static_cast<quint32>(m_check), trailer);
+        size = 4;
+    }
+    else if (m_format == GzipFormat)
+    {
+        qToLittleEndian<quint32>(static_cast<quint32>(m_check), trailer);
+        qToLittleEndian<quint32>(static_cast<quint32>(totalIn()), trailer + 4);
+        size = 8;
+    }
+
+    if (m_device->write(reinterpret_cast<char*>(trailer), size) != size)
+    {
+        setErrorString("error writing device");
+        return Z_ERRNO;
     }
+
+    m_totalOut += size;
+    return Z_STREAM_END;
 }
 
 void ZCompressor::setDevice(QIODevice *device)
@@ -59,20 +258,129 @@ void ZCompressor::setDevice(QIODevice *device)
     if (!isOpen() && m_device != device)
     {
         if (m_device)
-            disconnect(m_device, &QIODevice::readyRead, this, &ZCompressor::readyRead);
+        {
+            disconnect(m_device, &QIODevice::readyRead, this, &ZCompressor::deviceReadyRead);
+            disconnect(m_device, &QIODevice::bytesWritten, this,
+                       &ZCompressor::deviceBytesWritten);
+        }
 
         m_device = device;
-        connect(m_device, &QIODevice::readyRead, this, &ZCompressor::readyRead);
+        connect(m_device, &QIODevice::readyRead, this, &ZCompressor::deviceReadyRead);
+        connect(m_device, &QIODevice::bytesWritten, this, &ZCompressor::deviceBytesWritten);
+    }
+}
+
+bool ZCompressor::waitForReadyRead(int msecs)
+{
+    if (!(openMode() & QIODevice::ReadOnly))
+        return false;
+
+    if (bytesAvailable() > 0)
+        return true;
+
+    //Device data may be not enough for decompressed byte.
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_end)
+    {
+        const int left = msecs < 0 ? -1 : qMax(0, msecs - static_cast<int>(timer.elapsed()));
+        if (m_device->bytesAvailable() <= 0 && !m_device->waitForReadyRead(left))
+            return false;
+
+        if (fillReadBuffer() > 0)
+        {
+            emit readyRead();
+            return true;
+        }
+
+        if (msecs >= 0 && timer.hasExpired(msecs))
+            return false;
+    }
+
+    return false;
+}
+
+qint64 ZCompressor::bytesToWrite() const
+{
+    if (!(openMode() & QIODevice::WriteOnly))
+        return 0;
+
+    qint64 result = QIODevice::bytesToWrite() + m_device->bytesToWrite() + m_block.size();
+    if (!m_end && m_active)
+    {
+        unsigned pending = 0;
+        int bits = 0;
+        deflatePending(const_cast<z_stream*>(&m_strm), &pending, &bits);
+        result += pending + (bits > 0 ? 1 : 0);
+    }
+
+    return result;
+}
+
+void ZCompressor::deviceBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes)
+
+    //Data given to device is written, producer may continue while device is below mark.
+    if (m_written > 0 && (m_highWaterMark <= 0 || m_device->bytesToWrite() < m_highWaterMark))
+    {
+        const qint64 written = m_written;
+        m_written = 0;
+        emit bytesWritten(written);
     }
 }
 
 qint64 ZCompressor::writeData(const char *data, qint64 len)
 {
     if (!m_end)
-    {        
-        m_state = def(reinterpret_cast<unsigned char*>(const_cast<char*>(data)), len, Z_NO_FLUSH);
+    {
+        //Backpressure, nothing accepted until device drains below mark.
+        if (m_highWaterMark > 0)
+        {
+            if (m_device->bytesToWrite() >= m_highWaterMark)
+                return 0;
+
+            len = qMin(len, m_highWaterMark);
+        }
+
+        if ((m_state = activate()) != Z_OK)
+        {
+            m_end = true;
+            return -1;
+        }
+
+        //Resumed raw stream doesn't compute check value.
+        if (m_resumed)
+        {
+            if (m_format == ZlibFormat)
+                m_check = adler32(m_check, reinterpret_cast<const Bytef*>(data),
+                                  static_cast<uInt>(len));
+            else if (m_format == GzipFormat)
+                m_check = Crc32::update(static_cast<quint32>(m_check), data, len);
+        }
+
+        const bool adaptive = m_targetThroughput > 0 || m_writeBudget > 0;
+        QElapsedTimer timer;
+        if (adaptive)
+            timer.start();
+
+        if (m_format == BlockedGzipFormat)
+            m_state = defBlocks(reinterpret_cast<const unsigned char*>(data), len);
+        else
+            m_state = def(reinterpret_cast<unsigned char*>(const_cast<char*>(data)), len,
+                          Z_NO_FLUSH);
         if (m_state == Z_OK)
+        {
+            if (adaptive)
+                adapt(len, timer.nsecsElapsed());
+
+            //Data is compressed, stream ends if level is not changed.
+            if (m_state != Z_OK)
+                m_end = true;
+
+            m_written += len;
             return len;
+        }
         else
         {
             m_end = true;
@@ -83,147 +391,638 @@ qint64 ZCompressor::writeData(const char *data, qint64 len)
     return -1;
 }
 
-int ZCompressor::def(unsigned char *data, qint64 length, int flush)
+void ZCompressor::adapt(qint64 length, qint64 nsecs)
 {
-    int ret = Z_OK;
-    //Potential truncation!
-    m_strm.avail_in = static_cast<decltype(m_strm.avail_in)>(length);
-    m_strm.next_in = data;
+    m_adaptBytes += length;
+    m_adaptNsecs += nsecs;
+    ++m_adaptWrites;
 
+    //Write over budget lowers level at once.
+    const qint64 budget = static_cast<qint64>(m_writeBudget) * 1000;
+    const bool overBudget = budget > 0 && nsecs > budget * 2;
+    if (m_adaptBytes < ADAPT_WINDOW && !overBudget)
+        return;
+
+    //Step down if any target is missed, step up if all targets have spare time.
+    bool down = overBudget;
+    bool up = true;
+    if (m_targetThroughput > 0)
+    {
+        const double speed = m_adaptNsecs > 0
+                ? m_adaptBytes / (1024.0 * 1024.0) / (m_adaptNsecs / 1e9) : m_targetThroughput * 2;
+        down = down || speed < m_targetThroughput;
+        up = up && speed > m_targetThroughput * 1.5;
+    }
+
+    if (budget > 0)
+    {
+        const qint64 average = m_adaptNsecs / m_adaptWrites;
+        down = down || average > budget;
+        up = up && average < budget / 2;
+    }
+
+    m_adaptBytes = 0;
+    m_adaptNsecs = 0;
+    m_adaptWrites = 0;
+
+    const int level = qBound(m_minLevel, m_currentLevel + (down ? -1 : (up ? 1 : 0)), m_maxLevel);
+    if (level != m_currentLevel)
+        m_state = defParams(level);
+}
+
+int ZCompressor::defParams(int level)
+{
+    //Changing level may flush compressed data of previous level.
+    int ret;
+    qint64 have;
     do
     {
+        m_strm.avail_in = 0;
         m_strm.avail_out = CHUNK;
-        m_strm.next_out = m_buffer.data();
-
-        ret = deflate(&m_strm, flush);
-        Q_ASSERT(ret != Z_STREAM_ERROR);
+        m_strm.next_out = buffer();
 
-        qint64 have = CHUNK - m_strm.avail_out;
+        ret = deflateParams(&m_strm, level, Z_DEFAULT_STRATEGY);
+        countTotals();
+        have = CHUNK - m_strm.avail_out;
         if (m_device->write(reinterpret_cast<char*>(m_buffer.data()), have) != have)
         {
-            ret = Z_ERRNO;
             setErrorString("error writing device");
+            return Z_ERRNO;
+        }
+    }
+    while (ret == Z_BUF_ERROR && have > 0);
+
+    if (ret == Z_OK)
+        m_currentLevel = level;
+
+    //Level is kept if not changed.
+    return ret == Z_STREAM_ERROR ? ret : Z_OK;
+}
+
+int ZCompressor::def(unsigned char *data, qint64 length, int flush)
+{
+    //Long data is deflated by parts which fit in avail_in and in totals of stream.
+    int ret;
+    do
+    {
+        const qint64 part = qMin<qint64>(length, MAX_PART);
+        m_strm.avail_in = static_cast<decltype(m_strm.avail_in)>(part);
+        m_strm.next_in = data;
+
+        ret = defWrite(&m_strm, part == length ? flush : Z_NO_FLUSH, buffer(), m_device,
+                       m_options & RsyncableOption ? &m_rsync : nullptr, m_hashers);
+        countTotals();
+        data += part;
+        length -= part;
+    }
+    while (length > 0 && ret == Z_OK);
+
+    if (ret == Z_ERRNO)
+        setErrorString("error writing device");
+
+    return ret;
+}
+
+//static.
+int ZCompressor::defWrite(z_stream *strm, int flush, unsigned char *out, QIODevice *dest,
+                          unsigned *rsync, const ZHashers &hashers)
+{
+    int ret = Z_OK;
+    unsigned char *next = strm->next_in;
+    qint64 left = strm->avail_in;
+    strm->avail_out = CHUNK;
+    strm->next_out = out;
+
+    do
+    {
+        //Part to boundary is fully flushed, last part gets requested flush.
+        qint64 part = left;
+        int partFlush = flush;
+        if (rsync)
+        {
+            bool found;
+            part = rsyncBoundary(*rsync, next, left, found);
+            if (found && (part < left || flush == Z_NO_FLUSH))
+                partFlush = Z_FULL_FLUSH;
+        }
+
+        //Output doesn't depend on slices, only last slice gets flush of part.
+        qint64 partLeft = part;
+        do
+        {
+            const qint64 slice = qMin<qint64>(partLeft, CHUNK);
+            addHashData(hashers, reinterpret_cast<const char*>(next), slice);
+            strm->avail_in = static_cast<decltype(strm->avail_in)>(slice);
+            strm->next_in = next;
+
+            //Only full output chunks are written here, so slices don't add device writes.
+            for (;;)
+            {
+                ret = deflate(strm, slice == partLeft ? partFlush : Z_NO_FLUSH);
+                Q_ASSERT(ret != Z_STREAM_ERROR);
+                if (strm->avail_out != 0)
+                    break;
+
+                if (dest->write(reinterpret_cast<char*>(out), CHUNK) != CHUNK)
+                    return Z_ERRNO;
+                strm->avail_out = CHUNK;
+                strm->next_out = out;
+            }
+            Q_ASSERT(strm->avail_in == 0);
+
+            next += slice;
+            partLeft -= slice;
+        }
+        while (partLeft > 0);
+
+        left -= part;
+    }
+    while (left > 0);
+
+    //Rest of output, call without progress after full chunk isn't an error.
+    const qint64 have = CHUNK - strm->avail_out;
+    if (have > 0 && dest->write(reinterpret_cast<char*>(out), have) != have)
+        return Z_ERRNO;
+
+    return ret == Z_BUF_ERROR ? Z_OK : ret;
+}
+
+int ZCompressor::defBlocks(const unsigned char *data, qint64 length)
+{
+    int ret = Z_OK;
+    while (length > 0 && ret == Z_OK)
+    {
+        const int size = static_cast<int>(qMin<qint64>(length,
+                                                       BlockedGzip::BLOCK - m_block.size()));
+        //Hashers read data before it is compressed.
+        addHashData(m_hashers, reinterpret_cast<const char*>(data), size);
+        //Full blocks are compressed without copy.
+        if (m_block.isEmpty() && size == BlockedGzip::BLOCK)
+            ret = defBlock(data, size);
+        else
+        {
+            //Block buffer is allocated once.
+            if (m_block.capacity() < BlockedGzip::BLOCK)
+                m_block.reserve(BlockedGzip::BLOCK);
+
+            m_block.append(reinterpret_cast<const char*>(data), size);
+            if (m_block.size() == BlockedGzip::BLOCK)
+            {
+                ret = defBlock(reinterpret_cast<const unsigned char*>(m_block.constData()),
+                               m_block.size());
+                m_block.resize(0);
+            }
+        }
+
+        data += size;
+        length -= size;
+    }
+
+    return ret;
+}
+
+int ZCompressor::defBlock(const unsigned char *data, int length)
+{
+    if (!m_blockBuffer)
+        m_blockBuffer.reset(reinterpret_cast<unsigned char*>(malloc(BlockedGzip::MAX_BLOCK)));
+
+    const int size = BlockedGzip::def(&m_strm, data, length, m_blockBuffer.data());
+    if (size < 0)
+    {
+        setErrorString("error compressing block");
+        return Z_STREAM_ERROR;
+    }
+
+    m_index.append(m_totalOut, m_totalIn);
+    if (m_device->write(reinterpret_cast<char*>(m_blockBuffer.data()), size) != size)
+    {
+        setErrorString("error writing device");
+        return Z_ERRNO;
+    }
+
+    m_totalIn += length;
+    m_totalOut += size;
+    return Z_OK;
+}
+
+int ZCompressor::defEndBlocks()
+{
+    int ret = Z_OK;
+    if (!m_block.isEmpty())
+    {
+        ret = defBlock(reinterpret_cast<const unsigned char*>(m_block.constData()), m_block.size());
+        m_block.resize(0);
+        if (ret != Z_OK)
+            return ret;
+    }
+
+    const QByteArray eof = BlockedGzip::eofBlock();
+    if (m_device->write(eof) != eof.size())
+    {
+        setErrorString("error writing device");
+        return Z_ERRNO;
+    }
+
+    m_totalOut += eof.size();
+    return Z_STREAM_END;
+}
+
+//static.
+int ZCompressor::defBlocks(QIODevice *src, QIODevice *dest, int level, const ZHashers &hashers)
+{
+    ZCompressor cmprs(dest);
+    cmprs.setHashers(hashers);
+    cmprs.setCompressFormat(BlockedGzipFormat);
+    cmprs.setCompressLevel(level);
+    if (!cmprs.open(QIODevice::WriteOnly))
+        return cmprs.state();
+
+    //Full blocks of mapped file are compressed without copy.
+    FileMapper mapper(src);
+    if (mapper.isValid())
+    {
+        do
+        {
+            if (!mapper.next())
+                return Z_ERRNO;
+
+            if (cmprs.write(reinterpret_cast<const char*>(mapper.data()), mapper.size())
+                    != mapper.size())
+                return Z_ERRNO;
+        }
+        while (mapper.size() > 0);
+
+        mapper.seek(mapper.size());
+    }
+    else
+    {
+        QByteArray in(BlockedGzip::BLOCK, Qt::Uninitialized);
+        qint64 avail;
+        while ((avail = src->read(in.data(), in.size())) > 0)
+        {
+            if (cmprs.write(in.constData(), avail) != avail)
+                return Z_ERRNO;
+        }
+
+        if (avail < 0)
+            return Z_ERRNO;
+    }
+
+    cmprs.close();
+    return cmprs.state() == Z_STREAM_END ? Z_OK : cmprs.state();
+}
+
+//static.
+int ZCompressor::def(QIODevice *src, QIODevice *dest, int level, CompressFormat format,
+                     Options options, const ZHashers &hashers)
+{
+    //Blocks are compressed by device interface.
+    if (format == BlockedGzipFormat)
+        return defBlocks(src, dest, level, hashers);
+
+    if (options & PipelineOption)
+        return defPipeline(src, dest, level, format, options, hashers);
+
+    int ret, flush;
+    unsigned rsync = 0;
+    unsigned char in[CHUNK];
+    unsigned char out[CHUNK];
+
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+
+    ret = defInit(&strm, level, format);
+    if (ret != Z_OK)
+        return ret;
+
+    //Files are compressed directly from mapped memory.
+    FileMapper mapper(src);
+
+    do
+    {
+        if (mapper.isValid())
+        {
+            if (!mapper.next())
+            {
+                deflateEnd(&strm);
+                return Z_ERRNO;
+            }
+            //Window size is less than max of avail_in.
+            strm.avail_in = static_cast<decltype(strm.avail_in)>(mapper.size());
+
+            flush = mapper.atEnd() ? Z_FINISH : Z_NO_FLUSH;
+            strm.next_in = const_cast<unsigned char*>(mapper.data());
+        }
+        else
+        {
+            qint64 avail = src->read(reinterpret_cast<char*>(in), CHUNK);
+            if (avail < 0)
+            {
+                deflateEnd(&strm);
+                return Z_ERRNO;
+            }
+            //Potential truncation!
+            strm.avail_in = static_cast<decltype(strm.avail_in)>(avail);
+
+            flush = src->atEnd() ? Z_FINISH : Z_NO_FLUSH;
+            strm.next_in = reinterpret_cast<unsigned char*>(in);
+        }
+
+        ret = defWrite(&strm, flush, out, dest, options & RsyncableOption ? &rsync : nullptr,
+                       hashers);
+        if (ret == Z_ERRNO)
+        {
+            deflateEnd(&strm);
+            return Z_ERRNO;
+        }
+    }
+    while (flush != Z_FINISH);
+    Q_ASSERT(ret == Z_STREAM_END);
+
+    if (mapper.isValid())
+        mapper.seek(mapper.size());
+
+    deflateEnd(&strm);
+    return Z_OK;
+}
+
+//static.
+int ZCompressor::defParallel(QIODevice *src, QIODevice *dest, int level, CompressFormat format,
+                             int threads)
+{
+    return ParallelDeflate::def(src, dest, level, format, threads);
+}
+
+//static.
+int ZCompressor::infParallel(QIODevice *src, QIODevice *dest, CompressFormat format, int threads,
+                             const ZHashers &hashers)
+{
+    if (format == BlockedGzipFormat)
+        return BlockedGzip::inf(src, dest, threads, hashers);
+
+    return ParallelInflate::inf(src, dest, format, threads, hashers);
+}
+
+//static.
+int ZCompressor::defDelta(QIODevice *src, QIODevice *dest, QIODevice *reference, int level,
+                          const ZHashers &hashers)
+{
+    return DeltaDeflate::def(src, dest, reference, level, hashers);
+}
+
+//static.
+int ZCompressor::infDelta(QIODevice *src, QIODevice *dest, QIODevice *reference,
+                          const ZHashers &hashers)
+{
+    return DeltaDeflate::inf(src, dest, reference, hashers);
+}
+
+//static.
+int ZCompressor::def(const QByteArray &src, QIODevice *dest, int level, CompressFormat format,
+                     Options options)
+{
+    //Flush points don't fit in compress bound, so compressed by chunks.
+    if (format == BlockedGzipFormat || (options & RsyncableOption))
+    {
+        QBuffer buffer(const_cast<QByteArray*>(&src));
+        buffer.open(QIODevice::ReadOnly);
+        return def(&buffer, dest, level, format, options & RsyncableOption);
+    }
+
+    int ret;
+    unsigned char out[CHUNK];
+
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+
+    ret = defInit(&strm, level, format);
+    if (ret != Z_OK)
+        return ret;
+
+    //Source is deflated in place (zlib doesn't modify input) to dest by chunks.
+    strm.avail_in = static_cast<decltype(strm.avail_in)>(src.size());
+    strm.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(src.constData()));
+
+    ret = defWrite(&strm, Z_FINISH, out, dest, nullptr);
+    deflateEnd(&strm);
+    if (ret == Z_ERRNO)
+        return Z_ERRNO;
+
+    Q_ASSERT(ret == Z_STREAM_END);
+    return Z_OK;
+}
+
+void ZCompressor::deviceReadyRead()
+{
+    if (!(openMode() & QIODevice::ReadOnly))
+        return;
+
+    //Consumers are woken only if there is decompressed data.
+    const bool end = m_end;
+    if (fillReadBuffer() > 0)
+        emit readyRead();
+
+    if (!end && m_end)
+        emit readChannelFinished();
+}
+
+qint64 ZCompressor::fillReadBuffer()
+{
+    qint64 result = 0;
+    //Read data is dropped, so buffer doesn't grow past READ_AHEAD and CHUNK.
+    if (m_readPos > 0)
+    {
+        m_readBuffer.remove(0, m_readPos);
+        m_readPos = 0;
+    }
+
+    m_readPending = false;
+    if (!m_end && (m_state = activate()) != Z_OK)
+    {
+        m_end = true;
+        return result;
+    }
+
+    while (!m_end)
+    {
+        const int size = m_readBuffer.size();
+        if (size >= READ_AHEAD)
+        {
+            m_readPending = true;
+            break;
+        }
+
+        m_readBuffer.resize(size + static_cast<int>(CHUNK));
+
+        qint64 have;
+        m_state = inf(reinterpret_cast<unsigned char*>(m_readBuffer.data() + size), CHUNK, have);
+        if (m_state != Z_OK)
+            m_end = true;
+
+        have = qMax<qint64>(have, 0);
+        m_readBuffer.resize(size + static_cast<int>(have));
+        result += have;
+
+        //Output not full, input is used.
+        if (have < CHUNK)
             break;
-        }
     }
-    while (m_strm.avail_out == 0);
-    Q_ASSERT(m_strm.avail_in == 0);
 
-    return ret;
+    return result;
 }
 
-//static.
-int ZCompressor::def(QIODevice *src, QIODevice *dest, int level, CompressFormat format)
+qint64 ZCompressor::readData(char *data, qint64 maxlen)
 {
-    int ret, flush;
-    qint64 have;
-    unsigned char in[CHUNK];
-    unsigned char out[CHUNK];
-
-    z_stream strm;
-    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
-    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
-    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    //Data decompressed ahead first.
+    qint64 result = qMin<qint64>(maxlen, m_readBuffer.size() - m_readPos);
+    if (result > 0)
+    {
+        memcpy(data, m_readBuffer.constData() + m_readPos, static_cast<size_t>(result));
+        addHashData(m_hashers, data, result);
+        m_readPos += static_cast<int>(result);
+        if (m_readPos == m_readBuffer.size())
+        {
+            m_readBuffer.resize(0);
+            m_readPos = 0;
+        }
 
-    ret = defInit(&strm, level, format);
-    if (ret != Z_OK)
-        return ret;
+        data += result;
+        maxlen -= result;
+    }
 
-    do
+    if (!m_end && maxlen > 0)
     {
-        qint64 avail = src->read(reinterpret_cast<char*>(in), CHUNK);
-        if (avail < 0)
+        if ((m_state = activate()) != Z_OK)
         {
-            deflateEnd(&strm);
-            return Z_ERRNO;
+            m_end = true;
+            return result > 0 ? result : -1;
         }
-        //Potential truncation!
-        strm.avail_in = static_cast<decltype(strm.avail_in)>(avail);
 
-        flush = src->atEnd() ? Z_FINISH : Z_NO_FLUSH;
-        strm.next_in = reinterpret_cast<unsigned char*>(in);
+        qint64 have;
+        m_state = inf(reinterpret_cast<unsigned char*>(data), maxlen, have);
+        if (m_state != Z_OK)
+            m_end = true;
 
-        do
-        {
-            strm.avail_out = CHUNK;
-            strm.next_out = out;
+        if (have < 0)
+            return result > 0 ? result : have;
 
-            ret = deflate(&strm, flush);
-            Q_ASSERT(ret != Z_STREAM_ERROR);
+        addHashData(m_hashers, data, have);
+        //Output not full, input is used.
+        if (have < maxlen)
+            m_readPending = false;
 
-            have = CHUNK - strm.avail_out;
-            if (dest->write(reinterpret_cast<char*>(out), have) != have)
-            {
-                deflateEnd(&strm);
-                return Z_ERRNO;
-            }
-        }
-        while (strm.avail_out == 0);
-        Q_ASSERT(strm.avail_in == 0);
+        if (m_readPending)
+            fillReadBuffer();
+
+        return result + have;
     }
-    while (flush != Z_FINISH);
-    Q_ASSERT(ret == Z_STREAM_END);
 
-    deflateEnd(&strm);
-    return Z_OK;
+    //Decompression stopped at READ_AHEAD continues when buffer is read.
+    if (m_readPending && m_readPos == m_readBuffer.size())
+        fillReadBuffer();
+
+    return result > 0 || !m_end ? result : -1;
 }
 
-//static.
-int ZCompressor::def(const QByteArray &src, QIODevice *dest, int level, CompressFormat format)
+qint64 ZCompressor::pos() const
 {
-    int ret;
-    unsigned long availOut = compressBound(static_cast<unsigned long>(src.size()));
-    QScopedArrayPointer<unsigned char> out(new unsigned char[availOut]);
-    QScopedArrayPointer<unsigned char> in(new unsigned char[src.size()]);
+    if (!(openMode() & QIODevice::ReadOnly))
+        return QIODevice::pos();
 
-    z_stream strm;
-    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
-    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
-    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    return totalOut() - bytesAvailable();
+}
 
-    ret = defInit(&strm, level, format);
-    if (ret != Z_OK)
-        return ret;
+bool ZCompressor::seek(qint64 pos)
+{
+    if (!(openMode() & QIODevice::ReadOnly))
+        return false;
 
-    strm.avail_in = static_cast<decltype(strm.avail_in)>(src.size());
-    memcpy(in.data(), src.data(), static_cast<size_t>(src.size()));
-    strm.next_in = in.data();
-    strm.avail_out = static_cast<decltype(strm.avail_out)>(availOut);
-    strm.next_out = out.data();
+    const qint64 length = pos - this->pos();
+    return length >= 0 && skip(length) == length;
+}
 
-    do
+qint64 ZCompressor::skip(qint64 maxSize)
+{
+    if (!(openMode() & QIODevice::ReadOnly))
+        return -1;
+
+    //Data buffered by QIODevice is small (read through it).
+    qint64 result = 0;
+    const qint64 buffered = qMin(maxSize, QIODevice::bytesAvailable());
+    if (buffered > 0)
     {
-        ret = deflate(&strm, Z_FINISH);
-        Q_ASSERT(ret != Z_STREAM_ERROR);
+        QByteArray scratch(static_cast<int>(buffered), Qt::Uninitialized);
+        result = read(scratch.data(), buffered);
+        if (result < 0)
+            return -1;
+    }
 
-        qint64 have = static_cast<qint64>(availOut - strm.avail_out);
-        if (dest->write(reinterpret_cast<char*>(out.data()), have) != have)
-        {
-            deflateEnd(&strm);
-            return Z_ERRNO;
-        }
+    if (result < maxSize)
+    {
+        const qint64 skipped = skipData(maxSize - result);
+        if (skipped < 0)
+            return result > 0 ? result : -1;
 
-    } while (strm.avail_out == 0);
-    Q_ASSERT(strm.avail_in == 0);
-    Q_ASSERT(ret == Z_STREAM_END);
+        result += skipped;
+    }
 
-    deflateEnd(&strm);
-    return Z_OK;
+    return result;
 }
 
-qint64 ZCompressor::readData(char *data, qint64 maxlen)
+qint64 ZCompressor::skipData(qint64 maxSize)
 {
-    if (!m_end)
+    //Data decompressed ahead is skipped by position.
+    qint64 result = qMin<qint64>(maxSize, m_readBuffer.size() - m_readPos);
+    if (result > 0)
     {
+        addHashData(m_hashers, m_readBuffer.constData() + m_readPos, result);
+        m_readPos += static_cast<int>(result);
+        if (m_readPos == m_readBuffer.size())
+        {
+            m_readBuffer.resize(0);
+            m_readPos = 0;
+        }
+    }
+
+    while (!m_end && result < maxSize)
+    {
+        if ((m_state = activate()) != Z_OK)
+        {
+            m_end = true;
+            break;
+        }
+
+        if (!m_skipBuffer)
+        {
+            m_skipBuffer.reset(reinterpret_cast<unsigned char*>(malloc(SKIP_WINDOW)));
+            if (!m_skipBuffer)
+            {
+                setErrorString("out of memory");
+                return result > 0 ? result : -1;
+            }
+        }
+
+        const qint64 length = qMin(maxSize - result, SKIP_WINDOW);
         qint64 have;
-        m_state = inf(reinterpret_cast<unsigned char*>(data), maxlen, have);
+        m_state = inf(m_skipBuffer.data(), length, have);
         if (m_state != Z_OK)
             m_end = true;
 
-        return have;
+        if (have < 0)
+            return result > 0 ? result : -1;
+
+        addHashData(m_hashers, reinterpret_cast<const char*>(m_skipBuffer.data()), have);
+        result += have;
+        //Sequential device has no more data now.
+        if (have < length)
+            break;
     }
 
-    return -1;
+    return result;
 }
 
 int ZCompressor::inf(unsigned char *data, qint64 length, qint64 &have)
@@ -239,7 +1038,7 @@ int ZCompressor::inf(unsigned char *data, qint64 length, qint64 &have)
     {
         if (m_strm.avail_in <= 0)
         {
-            qint64 avail = m_device->read(reinterpret_cast<char*>(m_buffer.data()), CHUNK);
+            qint64 avail = m_device->read(reinterpret_cast<char*>(buffer()), CHUNK);
             if (avail < 0)
             {
                 ret = Z_ERRNO;
@@ -252,7 +1051,11 @@ int ZCompressor::inf(unsigned char *data, qint64 length, qint64 &have)
 
             if (avail == 0)
             {
-                if (m_device->isSequential())
+                //Blocked gzip ends after member (end of file block for sequential device).
+                if (m_format == BlockedGzipFormat && m_boundary
+                        && (m_eof || !m_device->isSequential()))
+                    ret = Z_STREAM_END;
+                else if (m_device->isSequential())
                     ret = Z_OK;
                 else
                 {
@@ -267,6 +1070,7 @@ int ZCompressor::inf(unsigned char *data, qint64 length, qint64 &have)
 
         ret = inflate(&m_strm, Z_NO_FLUSH);
         Q_ASSERT(ret != Z_STREAM_ERROR);
+        countTotals();
         switch (ret)
         {
         case Z_BUF_ERROR:
@@ -283,6 +1087,19 @@ int ZCompressor::inf(unsigned char *data, qint64 length, qint64 &have)
         }
 
         have = length - m_strm.avail_out;
+
+        //Blocked gzip is several gzip members.
+        if (m_format == BlockedGzipFormat)
+        {
+            m_boundary = ret == Z_STREAM_END;
+            if (m_boundary)
+            {
+                m_eof = m_strm.total_out == 0;
+                inflateReset(&m_strm);
+                resetTotals();
+                ret = Z_OK;
+            }
+        }
     }
     while (m_strm.avail_out != 0 && ret != Z_STREAM_END);
 
@@ -290,8 +1107,16 @@ int ZCompressor::inf(unsigned char *data, qint64 length, qint64 &have)
 }
 
 //static.
-int ZCompressor::inf(QIODevice *src, QIODevice *dest, CompressFormat format)
+int ZCompressor::inf(QIODevice *src, QIODevice *dest, CompressFormat format, Options options,
+                     const ZHashers &hashers)
 {
+    //Blocks are decompressed in parallel.
+    if (format == BlockedGzipFormat)
+        return BlockedGzip::inf(src, dest, QThread::idealThreadCount(), hashers);
+
+    if (options & PipelineOption)
+        return infPipeline(src, dest, format, hashers);
+
     int ret;
     qint64 have;
     unsigned char in[CHUNK];
@@ -308,23 +1133,39 @@ int ZCompressor::inf(QIODevice *src, QIODevice *dest, CompressFormat format)
     if (ret != Z_OK)
         return ret;
 
+    //Files are decompressed directly from mapped memory.
+    FileMapper mapper(src);
+
     do
     {
-        qint64 avail = src->read(reinterpret_cast<char*>(in), CHUNK);
-        if (avail < 0)
+        if (mapper.isValid())
         {
-            inflateEnd(&strm);
-            return Z_ERRNO;
+            if (!mapper.next())
+            {
+                inflateEnd(&strm);
+                return Z_ERRNO;
+            }
+            //Window size is less than max of avail_in.
+            strm.avail_in = static_cast<decltype(strm.avail_in)>(mapper.size());
+            strm.next_in = const_cast<unsigned char*>(mapper.data());
+        }
+        else
+        {
+            qint64 avail = src->read(reinterpret_cast<char*>(in), CHUNK);
+            if (avail < 0)
+            {
+                inflateEnd(&strm);
+                return Z_ERRNO;
+            }
+            //Potential truncation!
+            strm.avail_in = static_cast<decltype(strm.avail_in)>(avail);
+            strm.next_in = in;
         }
-        //Potential truncation!
-        strm.avail_in = static_cast<decltype(strm.avail_in)>(avail);
 
         //End of file but not compressed stream.
         if (strm.avail_in == 0)
             break;
 
-        strm.next_in = in;
-
         do
         {
             strm.avail_out = CHUNK;
@@ -344,6 +1185,7 @@ int ZCompressor::inf(QIODevice *src, QIODevice *dest, CompressFormat format)
             }
 
             have = CHUNK - strm.avail_out;
+            addHashData(hashers, reinterpret_cast<char*>(out), have);
             if (dest->write(reinterpret_cast<char*>(out), have) != have)
             {
                 inflateEnd(&strm);
@@ -354,12 +1196,280 @@ int ZCompressor::inf(QIODevice *src, QIODevice *dest, CompressFormat format)
     }
     while(ret != Z_STREAM_END);
 
+    //File position after compressed stream.
+    if (mapper.isValid())
+        mapper.seek(mapper.size() - strm.avail_in);
+
+    inflateEnd(&strm);
+    return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
+}
+
+//Expected decompressed size of gzip (ISIZE of trailer) or blocked gzip (sum of ISIZE), -1 if unknown.
+static qint64 inflatedSize(const QByteArray &src, ZCompressor::CompressFormat format)
+{
+    const uchar *data = reinterpret_cast<const uchar*>(src.constData());
+    if (format == ZCompressor::GzipFormat && src.size() >= 18)
+        return qFromLittleEndian<quint32>(data + src.size() - 4);
+
+    if (format == ZCompressor::BlockedGzipFormat)
+    {
+        qint64 result = 0;
+        for (int pos = 0; pos < src.size();)
+        {
+            const int size = BlockedGzip::blockSize(data + pos, src.size() - pos);
+            if (size < BlockedGzip::HEADER + BlockedGzip::TRAILER || size > src.size() - pos)
+                return -1;
+
+            //Block isn't larger than BLOCK.
+            result += qMin<quint32>(qFromLittleEndian<quint32>(data + pos + size - 4),
+                                    BlockedGzip::BLOCK);
+            pos += size;
+        }
+
+        return result;
+    }
+
+    return -1;
+}
+
+//static.
+int ZCompressor::inf(const QByteArray &src, QByteArray *dest, CompressFormat format)
+{
+    z_stream strm;
+    strm.zalloc = reinterpret_cast<decltype(strm.zalloc)>(Z_NULL);
+    strm.zfree = reinterpret_cast<decltype(strm.zfree)>(Z_NULL);
+    strm.opaque = reinterpret_cast<decltype(strm.opaque)>(Z_NULL);
+    strm.avail_in = 0;
+    strm.next_in = reinterpret_cast<decltype(strm.next_in)>(Z_NULL);
+
+    int ret = infInit(&strm, format);
+    if (ret != Z_OK)
+        return ret;
+
+    //Size from trailer is a hint (modulo 2^32, may be wrong), output still grows if needed. Extra
+    //byte lets inflate reach end of stream without growing full output. Deflate expands data at
+    //most 1032 times, so untrusted trailer doesn't allocate more.
+    const int maxSize = std::numeric_limits<int>::max() - 32;
+    const qint64 expected = qMin(inflatedSize(src, format), static_cast<qint64>(src.size()) * 1032);
+    const qint64 capacity = expected >= 0 ? expected + 1 : static_cast<qint64>(src.size()) * 4;
+    dest->resize(static_cast<int>(qBound<qint64>(CHUNK, capacity, maxSize)));
+
+    strm.avail_in = static_cast<decltype(strm.avail_in)>(src.size());
+    strm.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(src.constData()));
+    qint64 size = 0;
+    do
+    {
+        if (size == dest->size())
+        {
+            if (dest->size() == maxSize)
+            {
+                ret = Z_MEM_ERROR;
+                break;
+            }
+
+            dest->resize(static_cast<int>(qMin<qint64>(static_cast<qint64>(dest->size()) * 2,
+                                                       maxSize)));
+        }
+
+        strm.avail_out = static_cast<decltype(strm.avail_out)>(dest->size() - size);
+        strm.next_out = reinterpret_cast<unsigned char*>(dest->data()) + size;
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        Q_ASSERT(ret != Z_STREAM_ERROR);
+        size = dest->size() - strm.avail_out;
+
+        //Blocked gzip is several gzip members.
+        if (ret == Z_STREAM_END && format == BlockedGzipFormat && strm.avail_in > 0)
+        {
+            inflateReset(&strm);
+            ret = Z_OK;
+        }
+    }
+    while (ret == Z_OK);
+
+    inflateEnd(&strm);
+    dest->resize(static_cast<int>(size));
+
+    switch (ret)
+    {
+    case Z_STREAM_END:
+        return Z_OK;
+    case Z_NEED_DICT:
+    case Z_BUF_ERROR:
+        //Not enough input.
+        return Z_DATA_ERROR;
+    default:
+        return ret;
+    }
+}
+
+//static.
+int ZCompressor::defPipeline(QIODevice *src, QIODevice *dest, int level, CompressFormat format,
+                             Options options, const ZHashers &hashers)
+{
+    z_stream strm;
+    int ret = defInit(&strm, level, format);
+    if (ret != Z_OK)
+        return ret;
+
+    unsigned rsync = 0;
+    Pipeline pipeline(src, dest);
+    PipelineBuffer *out = pipeline.takeOutput();
+    int flush = Z_NO_FLUSH;
+    while (out && flush != Z_FINISH)
+    {
+        PipelineBuffer *in = pipeline.takeInput();
+        if (!in)
+            break;
+
+        flush = in->last ? Z_FINISH : Z_NO_FLUSH;
+        addHashData(hashers, reinterpret_cast<const char*>(in->data), in->size);
+        unsigned char *next = in->data;
+        qint64 left = in->size;
+        do
+        {
+            //Part to boundary of rolling hash is fully flushed.
+            qint64 part = left;
+            int partFlush = flush;
+            if (options & RsyncableOption)
+            {
+                bool found;
+                part = rsyncBoundary(rsync, next, left, found);
+                if (found && (part < left || flush == Z_NO_FLUSH))
+                    partFlush = Z_FULL_FLUSH;
+            }
+
+            //Buffer size is less than max of avail_in.
+            strm.avail_in = static_cast<decltype(strm.avail_in)>(part);
+            strm.next_in = next;
+
+            do
+            {
+                //Full buffer goes to writer thread.
+                if (out->size == Pipeline::BUFFER)
+                {
+                    pipeline.putOutput(out);
+                    out = pipeline.takeOutput();
+                    if (!out)
+                        break;
+                }
+
+                strm.avail_out = static_cast<decltype(strm.avail_out)>(Pipeline::BUFFER
+                                                                        - out->size);
+                strm.next_out = out->data + out->size;
+
+                ret = deflate(&strm, partFlush);
+                Q_ASSERT(ret != Z_STREAM_ERROR);
+
+                out->size = Pipeline::BUFFER - strm.avail_out;
+            }
+            while (strm.avail_out == 0);
+
+            next += part;
+            left -= part;
+        }
+        while (out && left > 0);
+
+        pipeline.recycleInput(in);
+    }
+
+    if (out)
+    {
+        out->last = true;
+        pipeline.putOutput(out);
+    }
+
+    const bool ok = pipeline.finish();
+    deflateEnd(&strm);
+
+    return ok && ret == Z_STREAM_END ? Z_OK : Z_ERRNO;
+}
+
+//static.
+int ZCompressor::infPipeline(QIODevice *src, QIODevice *dest, CompressFormat format,
+                             const ZHashers &hashers)
+{
+    z_stream strm;
+    int ret = infInit(&strm, format);
+    if (ret != Z_OK)
+        return ret;
+
+    Pipeline pipeline(src, dest);
+    PipelineBuffer *out = pipeline.takeOutput();
+    bool error = false;
+    while (out && !error && ret != Z_STREAM_END)
+    {
+        PipelineBuffer *in = pipeline.takeInput();
+        if (!in)
+            break;
+
+        //End of file but not compressed stream.
+        if (in->last)
+        {
+            pipeline.recycleInput(in);
+            break;
+        }
+
+        //Buffer size is less than max of avail_in.
+        strm.avail_in = static_cast<decltype(strm.avail_in)>(in->size);
+        strm.next_in = in->data;
+
+        do
+        {
+            //Full buffer goes to writer thread.
+            if (out->size == Pipeline::BUFFER)
+            {
+                pipeline.putOutput(out);
+                out = pipeline.takeOutput();
+                if (!out)
+                    break;
+            }
+
+            strm.avail_out = static_cast<decltype(strm.avail_out)>(Pipeline::BUFFER - out->size);
+            strm.next_out = out->data + out->size;
+            const qint64 size = out->size;
+
+            ret = inflate(&strm, Z_NO_FLUSH);
+            Q_ASSERT(ret != Z_STREAM_ERROR);
+            switch (ret)
+            {
+            case Z_NEED_DICT:
+                ret = Z_DATA_ERROR;
+            [[clang::fallthrough]];
+            case Z_DATA_ERROR:
+            case Z_MEM_ERROR:
+                error = true;
+                break;
+            }
+
+            out->size = Pipeline::BUFFER - strm.avail_out;
+            addHashData(hashers, reinterpret_cast<const char*>(out->data) + size, out->size - size);
+        }
+        while (!error && strm.avail_out == 0);
+
+        pipeline.recycleInput(in);
+    }
+
+    if (out)
+    {
+        out->last = true;
+        pipeline.putOutput(out);
+    }
+
+    const bool ok = pipeline.finish();
     inflateEnd(&strm);
+
+    if (error)
+        return ret;
+
+    if (!ok)
+        return Z_ERRNO;
+
     return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
 }
 
 //static.
-int ZCompressor::defInit(z_stream *strm, int level, CompressFormat format)
+int ZCompressor::defInit(z_stream *strm, int level, CompressFormat format, bool raw)
 {
     strm->zalloc = reinterpret_cast<decltype(strm->zalloc)>(Z_NULL);
     strm->zfree = reinterpret_cast<decltype(strm->zfree)>(Z_NULL);
@@ -372,10 +1482,13 @@ int ZCompressor::defInit(z_stream *strm, int level, CompressFormat format)
     switch (format)
     {
     case ZlibFormat:
-        return deflateInit2(strm, level, Z_DEFLATED, MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        return deflateInit2(strm, level, Z_DEFLATED, raw ? -MAX_WBITS : MAX_WBITS, 8,
+                            Z_DEFAULT_STRATEGY);
     case GzipFormat:
-        return deflateInit2(strm, level, Z_DEFLATED, 30, 8, Z_DEFAULT_STRATEGY);
+        //Distances of resumed data don't exceed window of stream header.
+        return deflateInit2(strm, level, Z_DEFLATED, raw ? -14 : 30, 8, Z_DEFAULT_STRATEGY);
     case RawDeflateFormat:
+    case BlockedGzipFormat:
         return deflateInit2(strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
     }
 
@@ -398,9 +1511,12 @@ int ZCompressor::infInit(z_stream *strm, CompressFormat format)
     case ZlibFormat:
         return inflateInit2(strm, MAX_WBITS);
     case GzipFormat:
-        return inflateInit2(strm, 30);
+        //Any gzip window is read (parallel deflate and other tools write 32 KiB).
+        return inflateInit2(strm, 31);
     case RawDeflateFormat:
         return inflateInit2(strm, -MAX_WBITS);
+    case BlockedGzipFormat:
+        return inflateInit2(strm, 31);
     }
 
     return Z_ERRNO;
@@ -18,7 +18,11 @@
 #ifndef ZCOMPRESSOR_H
 #define ZCOMPRESSOR_H
 
+#include "blockedgzip.h"
+#include "zhasher.h"
+
 #include <QIODevice>
+#include <QByteArray>
 #include <zlib.h>
 
 class ZCompressor : public QIODevice
@@ -30,20 +34,35 @@ public:
     {
         ZlibFormat,
         GzipFormat,
-        RawDeflateFormat
+        RawDeflateFormat,
+        //Independent gzip members of BlockedGzip::BLOCK bytes, readable by gzip tools.
+        BlockedGzipFormat
+    };
+
+    enum Option
+    {
+        NoOptions = 0x0,
+        //Static def/inf read source and write destination in own threads, while compressing.
+        //Only for devices that may be used from other threads (files, buffers).
+        PipelineOption = 0x1,
+        //Deflate is fully flushed at points defined by rolling hash of input, so unchanged
+        //regions give same compressed bytes (rsync, deduplication). Ignored by BlockedGzipFormat.
+        RsyncableOption = 0x2
     };
+    Q_DECLARE_FLAGS(Options, Option)
 
+    //Buffers and stream state are allocated on first read or write.
     explicit ZCompressor(QObject *parent = nullptr)
-        : QIODevice(parent), m_buffer(reinterpret_cast<unsigned char*>(malloc(CHUNK)))
+        : QIODevice(parent)
     {
 
     }
 
     explicit ZCompressor(QIODevice *device, QObject *parent = nullptr)
-        : QIODevice(parent), m_device(device),
-          m_buffer(reinterpret_cast<unsigned char*>(malloc(CHUNK)))
+        : QIODevice(parent), m_device(device)
     {
-        connect(m_device, &QIODevice::readyRead, this, &ZCompressor::readyRead);
+        connect(m_device, &QIODevice::readyRead, this, &ZCompressor::deviceReadyRead);
+        connect(m_device, &QIODevice::bytesWritten, this, &ZCompressor::deviceBytesWritten);
     }
 
     ~ZCompressor() override
@@ -62,40 +81,56 @@ public:
 
     bool atEnd() const override
     {
-        return m_end && QIODevice::atEnd();
+        return m_end && m_readPos == m_readBuffer.size() && QIODevice::atEnd();
     }
 
+    //Decompressed bytes only, data is decompressed when device emits readyRead.
     qint64 bytesAvailable() const override
     {
         if (openMode() & QIODevice::ReadOnly)
-        {
-            qint64 result = QIODevice::bytesAvailable();
-            if (result <= 0)
-                result = m_device->bytesAvailable() + m_strm.avail_in;
-
-            return result;
-        }
-
-        return 0;
-    }
-
-    qint64 bytesToWrite() const override
-    {
-        if (openMode() & QIODevice::WriteOnly)
-        {   
-            qint64 result = QIODevice::bytesToWrite();
-            if (result <= 0)
-                result = m_device->bytesToWrite() + m_strm.avail_in;
-
-            return result;
-        }
+            return QIODevice::bytesAvailable() + m_readBuffer.size() - m_readPos;
 
         return 0;
     }
 
-    static int def(QIODevice *src, QIODevice *dest, int level, CompressFormat format);
-    static int def(const QByteArray &src, QIODevice *dest, int level, CompressFormat format);
-    static int inf(QIODevice *src, QIODevice *dest, CompressFormat format);
+    bool waitForReadyRead(int msecs) override;
+
+    //Read position is count of decompressed bytes read or skipped.
+    qint64 pos() const override;
+    //Only forward seek in read mode, data to position is skipped.
+    bool seek(qint64 pos) override;
+    //Skips decompressed data without copy to caller, data is inflated to internal scratch window.
+    //Hides QIODevice::skip (not virtual in Qt 5).
+    qint64 skip(qint64 maxSize);
+
+    //Compressed bytes waiting in device and deflate, and data of unfinished block.
+    qint64 bytesToWrite() const override;
+
+    //Hashers are fed with uncompressed data.
+    static int def(QIODevice *src, QIODevice *dest, int level, CompressFormat format,
+                   Options options = NoOptions, const ZHashers &hashers = ZHashers());
+    static int def(const QByteArray &src, QIODevice *dest, int level, CompressFormat format,
+                   Options options = NoOptions);
+    static int inf(QIODevice *src, QIODevice *dest, CompressFormat format,
+                   Options options = NoOptions, const ZHashers &hashers = ZHashers());
+    //Decompresses src directly to dest. Size of gzip (sum of blocks sizes for blocked gzip) is read
+    //from trailer to allocate dest once, otherwise dest grows twice.
+    static int inf(const QByteArray &src, QByteArray *dest, CompressFormat format);
+    //Compresses src to one stream in several threads (blocks of 128 KiB primed with previous
+    //32 KiB, as pigz). Output is slightly larger than by def.
+    static int defParallel(QIODevice *src, QIODevice *dest, int level, CompressFormat format,
+                           int threads);
+    //Decompresses one stream in several threads: chunks of mapped file are decoded speculatively
+    //from guessed block starts (as rapidgzip). Not mapped source is decompressed by inf.
+    static int infParallel(QIODevice *src, QIODevice *dest, CompressFormat format, int threads,
+                           const ZHashers &hashers = ZHashers());
+    //Compresses src against reference (previous version of same data): blocks of 4 KiB are zlib
+    //streams with reference data around same position as preset dictionary, unchanged data takes
+    //about 1-2% of its size. Decompressed only by infDelta with same reference.
+    static int defDelta(QIODevice *src, QIODevice *dest, QIODevice *reference, int level,
+                        const ZHashers &hashers = ZHashers());
+    static int infDelta(QIODevice *src, QIODevice *dest, QIODevice *reference,
+                        const ZHashers &hashers = ZHashers());
 
     void setDevice(QIODevice *device);
 
@@ -114,6 +149,64 @@ public:
         return m_level;
     }
 
+    //Adaptive level: level of stream is lowered while compression is slower than target
+    //(MB/s of input) or average write takes more than budget (microseconds), and raised while
+    //there is spare time. 0 - off.
+    void setTargetThroughput(double mbPerSecond) noexcept
+    {
+        m_targetThroughput = mbPerSecond;
+    }
+
+    double targetThroughput() const noexcept
+    {
+        return m_targetThroughput;
+    }
+
+    void setWriteTimeBudget(int usecs) noexcept
+    {
+        m_writeBudget = usecs;
+    }
+
+    int writeTimeBudget() const noexcept
+    {
+        return m_writeBudget;
+    }
+
+    //Bounds of adaptive level.
+    void setLevelRange(int minLevel, int maxLevel) noexcept
+    {
+        m_minLevel = minLevel;
+        m_maxLevel = maxLevel;
+    }
+
+    int minLevel() const noexcept
+    {
+        return m_minLevel;
+    }
+
+    int maxLevel() const noexcept
+    {
+        return m_maxLevel;
+    }
+
+    //Level of stream now (differs from compressLevel in adaptive mode).
+    int currentLevel() const noexcept
+    {
+        return m_currentLevel;
+    }
+
+    //Hashers (not owned) are fed with uncompressed data written or read (skipped too), results are
+    //complete after close.
+    void setHashers(const ZHashers &hashers)
+    {
+        m_hashers = hashers;
+    }
+
+    const ZHashers& hashers() const noexcept
+    {
+        return m_hashers;
+    }
+
     void setCompressFormat(CompressFormat format) noexcept
     {
         m_format = format;
@@ -124,43 +217,171 @@ public:
         return m_format;
     }
 
+    //Data is not accepted while device has more than mark bytes to write, bytesWritten is emitted
+    //when device drains. 0 - no limit.
+    void setHighWaterMark(qint64 mark) noexcept
+    {
+        m_highWaterMark = mark;
+    }
+
+    qint64 highWaterMark() const noexcept
+    {
+        return m_highWaterMark;
+    }
+
+    //Only RsyncableOption is used by device.
+    void setOptions(Options options) noexcept
+    {
+        m_options = options;
+    }
+
+    Options options() const noexcept
+    {
+        return m_options;
+    }
+
     int state() const noexcept
     {
         return m_state;
     }
 
-    unsigned long totalIn() const noexcept
+    qint64 totalIn() const noexcept
     {
-        return m_strm.total_in;
+        return m_totalIn + static_cast<uLong>(m_strm.total_in - m_streamIn);
     }
 
-    unsigned long totalOut() const noexcept
+    qint64 totalOut() const noexcept
     {
-        return m_strm.total_out;
+        return m_totalOut + static_cast<uLong>(m_strm.total_out - m_streamOut);
+    }
+
+    //Releases stream state and buffers of idle device, they are allocated again on next write.
+    //Write mode: compressor is fully flushed (all data given to device), next data continues
+    //stream. Read mode: only buffers without data are released, inflate state is needed for next
+    //data. Returns false if device is not open or stream is ended.
+    bool hibernate();
+
+    bool isHibernated() const noexcept
+    {
+        return !m_active;
+    }
+
+    //Index of blocks written in BlockedGzipFormat.
+    const BlockedGzipIndex& blockIndex() const noexcept
+    {
+        return m_index;
     }
 
 protected:
     // QIODevice interface
     qint64 readData(char *data, qint64 maxlen) override;
     qint64 writeData(const char *data, qint64 len) override;
+    //Skips read buffer and inflates rest (data buffered by QIODevice is not skipped).
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    qint64 skipData(qint64 maxSize) override;
+#else
+    qint64 skipData(qint64 maxSize);
+#endif
 
 private:
-    static int defInit(z_stream *strm, int level, CompressFormat format);
+    //Raw deflate with window of format if raw is set (stream resumed after hibernate).
+    static int defInit(z_stream *strm, int level, CompressFormat format, bool raw = false);
     static int infInit(z_stream *strm, CompressFormat format);
+    static int defPipeline(QIODevice *src, QIODevice *dest, int level, CompressFormat format,
+                           Options options, const ZHashers &hashers);
+    static int infPipeline(QIODevice *src, QIODevice *dest, CompressFormat format,
+                           const ZHashers &hashers);
+    static int defBlocks(QIODevice *src, QIODevice *dest, int level, const ZHashers &hashers);
+    //Deflates all input of strm to dest through out buffer of CHUNK bytes. Input is fully flushed
+    //at boundaries of rolling hash if rsync is not null. Input is given to deflate by CHUNK slices,
+    //hashers are fed with slice before it is deflated (while it is in cache). Only full chunks and
+    //rest of output after all input are written to dest.
+    static int defWrite(z_stream *strm, int flush, unsigned char *out, QIODevice *dest,
+                        unsigned *rsync, const ZHashers &hashers = ZHashers());
 
     constexpr static unsigned CHUNK{16384};
+    //Max input of one deflate call of device.
+    constexpr static qint64 MAX_PART{1024 * 1024 * 1024};
+    //Scratch window of skipped data.
+    constexpr static qint64 SKIP_WINDOW{64 * 1024};
+    //High water mark of data decompressed ahead, rest is decompressed when buffer is read.
+    constexpr static int READ_AHEAD{8 * CHUNK};
+
+    void deviceBytesWritten(qint64 bytes);
+    void deviceReadyRead();
+    //Decompresses available data of device to read buffer (up to READ_AHEAD), returns
+    //decompressed size.
+    qint64 fillReadBuffer();
+
+    //Initializes stream state if not initialized yet, continues raw stream after hibernate.
+    int activate();
+    //Adds new part of stream totals to totals.
+    void countTotals();
+    //Totals of stream are zero (stream is reset or ended).
+    void resetTotals();
+    unsigned char* buffer();
+    int defTrailer();
+    //Measures compression of written data, changes level of stream by one step after window.
+    void adapt(qint64 length, qint64 nsecs);
+    int defParams(int level);
 
     int def(unsigned char *data, qint64 length, int flush);
     int inf(unsigned char *data, qint64 length, qint64 &have);
+    int defBlocks(const unsigned char *data, qint64 length);
+    int defBlock(const unsigned char *data, int length);
+    int defEndBlocks();
 
     QIODevice *m_device{nullptr};
     z_stream m_strm;
     int m_level{6};
+    int m_currentLevel{6};
+    double m_targetThroughput{0};
+    int m_writeBudget{0};
+    int m_minLevel{1};
+    int m_maxLevel{9};
+    //Measures of adaptive level window.
+    qint64 m_adaptBytes{0};
+    qint64 m_adaptNsecs{0};
+    int m_adaptWrites{0};
     CompressFormat m_format{ZlibFormat};
+    Options m_options{NoOptions};
+    //Rolling hash of input for RsyncableOption.
+    unsigned m_rsync{0};
     int m_state{Z_OK};
     bool m_end{false};
+    //Stream state is initialized.
+    bool m_active{false};
+    //Write continues as raw deflate after hibernate, check value and trailer are made manually.
+    bool m_resumed{false};
+    uLong m_check{0};
+    qint64 m_highWaterMark{0};
+    //Data accepted since last bytesWritten.
+    qint64 m_written{0};
+    //Data decompressed ahead on readyRead and its read position.
+    QByteArray m_readBuffer;
+    int m_readPos{0};
+    //Read buffer reached READ_AHEAD, device may have more data.
+    bool m_readPending{false};
+    ZHashers m_hashers;
+    //Totals of previous streams (blocks or gzip members) and counted part of stream. Totals of
+    //z_stream are unsigned long (32-bit on Windows), so they are added after every call.
+    qint64 m_totalIn{0};
+    qint64 m_totalOut{0};
+    uLong m_streamIn{0};
+    uLong m_streamOut{0};
+
+    //Blocked gzip: uncompressed data of current block and compressed block.
+    QByteArray m_block;
+    QScopedPointer<unsigned char, QScopedPointerPodDeleter> m_blockBuffer;
+    BlockedGzipIndex m_index;
+    //Blocked gzip read: end of member and member was empty (end of file block).
+    bool m_boundary{false};
+    bool m_eof{false};
 
     QScopedPointer<unsigned char, QScopedPointerPodDeleter> m_buffer;
+    QScopedPointer<unsigned char, QScopedPointerPodDeleter> m_skipBuffer;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(ZCompressor::Options)
+
 #endif // ZCOMPRESSOR_H
@@ -0,0 +1,46 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "zhasher.h"
+#include "crc32simd.h"
+
+#include <QtEndian>
+
+void ZCryptographicHasher::addData(const char *data, qint64 length)
+{
+    //addData takes int length in Qt 5.
+    while (length > 0)
+    {
+        const int part = static_cast<int>(qMin<qint64>(length, 1 << 30));
+        m_hash.addData(data, part);
+        data += part;
+        length -= part;
+    }
+}
+
+void ZCrc32Hasher::addData(const char *data, qint64 length)
+{
+    m_crc = Crc32::update(m_crc, data, length);
+}
+
+QByteArray ZCrc32Hasher::result() const
+{
+    QByteArray bytes(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(m_crc, reinterpret_cast<uchar*>(bytes.data()));
+    return bytes;
+}
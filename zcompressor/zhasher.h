@@ -0,0 +1,97 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZHASHER_H
+#define ZHASHER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QCryptographicHash>
+
+//Hash of uncompressed data, fed by ZCompressor while data is compressed or decompressed. Other
+//algorithms (CRC32C, xxHash) are added by subclassing.
+class ZHasher
+{
+public:
+    virtual ~ZHasher() = default;
+
+    virtual void addData(const char *data, qint64 length) = 0;
+    virtual QByteArray result() const = 0;
+    virtual void reset() = 0;
+};
+
+typedef QVector<ZHasher*> ZHashers;
+
+//Feeds data to every hasher.
+inline void addHashData(const ZHashers &hashers, const char *data, qint64 length)
+{
+    if (length > 0)
+    {
+        for (ZHasher *hasher : hashers)
+            hasher->addData(data, length);
+    }
+}
+
+//Hash by QCryptographicHash (MD5, SHA-1, SHA-2, SHA-3).
+class ZCryptographicHasher : public ZHasher
+{
+public:
+    explicit ZCryptographicHasher(QCryptographicHash::Algorithm algorithm)
+        : m_hash(algorithm)
+    {
+
+    }
+
+    void addData(const char *data, qint64 length) override;
+
+    QByteArray result() const override
+    {
+        return m_hash.result();
+    }
+
+    void reset() override
+    {
+        m_hash.reset();
+    }
+
+private:
+    QCryptographicHash m_hash;
+};
+
+//CRC32 (zip, gzip), result is big endian.
+class ZCrc32Hasher : public ZHasher
+{
+public:
+    void addData(const char *data, qint64 length) override;
+    QByteArray result() const override;
+
+    void reset() override
+    {
+        m_crc = 0;
+    }
+
+    quint32 value() const noexcept
+    {
+        return m_crc;
+    }
+
+private:
+    quint32 m_crc{0};
+};
+
+#endif // ZHASHER_H
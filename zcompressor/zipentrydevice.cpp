@@ -0,0 +1,386 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "zipentrydevice.h"
+#include "zipreader.h"
+#include "zstdcompressor.h"
+
+#include <QFileDevice>
+#include <QFileInfo>
+
+#ifdef ZCOMPRESSOR_ZSTD
+//Compressed bytes of entry as device for decompressor. Archive may be shared, position is kept by
+//range.
+class ZipEntryRange : public QIODevice
+{
+public:
+    ZipEntryRange(QIODevice *archive, qint64 offset, qint64 size)
+        : m_archive(archive), m_offset(offset), m_size(size)
+    {
+
+    }
+
+    qint64 size() const override
+    {
+        return m_size;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        if (m_archive->pos() != m_offset + m_read && !m_archive->seek(m_offset + m_read))
+            return -1;
+
+        const qint64 avail = m_archive->read(data, qMin(maxlen, m_size - m_read));
+        if (avail > 0)
+            m_read += avail;
+
+        return avail;
+    }
+
+    qint64 writeData(const char *data, qint64 len) override
+    {
+        Q_UNUSED(data)
+        Q_UNUSED(len)
+        return -1;
+    }
+
+private:
+    QIODevice *m_archive;
+    qint64 m_offset;
+    qint64 m_size;
+    qint64 m_read{0};
+};
+#endif
+
+//static.
+QString ZipEntryCache::key(QIODevice *archive, const ZipHeader &header)
+{
+    QString archiveKey;
+    QFileDevice *file = qobject_cast<QFileDevice*>(archive);
+    if (file && !file->fileName().isEmpty())
+        archiveKey = QFileInfo(file->fileName()).absoluteFilePath();
+    else
+        archiveKey = QString::number(reinterpret_cast<quintptr>(archive), 16);
+
+    return QStringLiteral("%1:%2:%3").arg(archiveKey).arg(header.offset())
+            .arg(QString::fromUtf8(header.name()));
+}
+
+bool ZipEntryCache::find(const QString &key, QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    const QByteArray *cached = m_cache.object(key);
+    if (cached)
+    {
+        data = *cached;
+        ++m_hits;
+        return true;
+    }
+
+    ++m_misses;
+    return false;
+}
+
+void ZipEntryCache::insert(const QString &key, const QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    //Cache takes ownership, object is deleted if cost is greater than max cost.
+    m_cache.insert(key, new QByteArray(data), qMax(1, data.size()));
+}
+
+void ZipEntryCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+void ZipEntryCache::setMaxSize(int size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(size);
+}
+
+int ZipEntryCache::maxSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cache.maxCost();
+}
+
+int ZipEntryCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cache.totalCost();
+}
+
+quint64 ZipEntryCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+quint64 ZipEntryCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+bool ZipEntryDevice::open(QIODevice::OpenMode mode)
+{
+    if (!isOpen() && m_archive && m_archive->isReadable() && (mode & QIODevice::ReadOnly)
+            && !(mode & QIODevice::WriteOnly))
+    {
+        m_end = false;
+        m_cached = false;
+        m_collect = false;
+        m_out = 0;
+        m_data.clear();
+
+        if (m_cache)
+        {
+            m_key = ZipEntryCache::key(m_archive, m_header);
+            m_cached = m_cache->find(m_key, m_data);
+            if (m_cached)
+                return QIODevice::open(mode);
+        }
+
+        m_in = ZipReader::dataOffset(m_archive, m_header);
+        if (m_in < 0)
+        {
+            setErrorString("invalid local file header");
+            return false;
+        }
+        m_inLeft = m_header.compressedSize();
+
+        switch (m_header.compressionMethod())
+        {
+        case 0:
+            break;
+        case 8:
+            m_strm.zalloc = reinterpret_cast<decltype(m_strm.zalloc)>(Z_NULL);
+            m_strm.zfree = reinterpret_cast<decltype(m_strm.zfree)>(Z_NULL);
+            m_strm.opaque = reinterpret_cast<decltype(m_strm.opaque)>(Z_NULL);
+            m_strm.avail_in = 0;
+            m_strm.next_in = reinterpret_cast<decltype(m_strm.next_in)>(Z_NULL);
+            if (inflateInit2(&m_strm, -MAX_WBITS) != Z_OK)
+                return false;
+
+            m_inflate = true;
+            if (!m_buffer)
+                m_buffer.reset(reinterpret_cast<unsigned char*>(malloc(CHUNK)));
+            break;
+#ifdef ZCOMPRESSOR_ZSTD
+        case 93:
+            //Range is not sequential, so end of compressed bytes before end of frame is error.
+            m_range = new ZipEntryRange(m_archive, m_in, m_inLeft);
+            m_range->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+            m_zstd = new ZstdCompressor(m_range);
+            if (!m_zstd->open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+            {
+                setErrorString("error initializing zstd");
+                close();
+                return false;
+            }
+            break;
+#endif
+        default:
+            setErrorString("unsupported compression method");
+            return false;
+        }
+
+        //Collect decompressed data if it fits in cache.
+        if (m_cache && m_header.uncompressedSize() <= static_cast<quint32>(m_cache->maxSize()))
+        {
+            m_collect = true;
+            m_data.reserve(static_cast<int>(m_header.uncompressedSize()));
+        }
+
+        QIODevice::open(mode);
+    }
+
+    return isOpen();
+}
+
+void ZipEntryDevice::close()
+{
+    if (isOpen())
+    {
+        QIODevice::close();
+        if (m_inflate)
+        {
+            inflateEnd(&m_strm);
+            m_inflate = false;
+        }
+
+        m_data.clear();
+    }
+
+#ifdef ZCOMPRESSOR_ZSTD
+    //Decompressor is closed before its range.
+    delete m_zstd;
+    m_zstd = nullptr;
+    delete m_range;
+    m_range = nullptr;
+#endif
+}
+
+qint64 ZipEntryDevice::readData(char *data, qint64 maxlen)
+{
+    if (m_cached)
+    {
+        const qint64 have = qMin(maxlen, m_data.size() - m_out);
+        if (have <= 0)
+        {
+            m_end = true;
+            return -1;
+        }
+
+        memcpy(data, m_data.constData() + m_out, static_cast<size_t>(have));
+        m_out += have;
+        m_end = m_out == m_data.size();
+        return have;
+    }
+
+    if (!m_end)
+    {
+        qint64 have;
+        if (m_inflate)
+        {
+            const int ret = inf(reinterpret_cast<unsigned char*>(data), maxlen, have);
+            if (ret != Z_OK)
+                m_end = true;
+        }
+#ifdef ZCOMPRESSOR_ZSTD
+        else if (m_zstd)
+        {
+            have = m_zstd->read(data, maxlen);
+            if (m_zstd->state() != Z_OK)
+                m_end = true;
+            if (m_zstd->state() != Z_OK && m_zstd->state() != Z_STREAM_END)
+            {
+                setErrorString(m_zstd->errorString());
+                have = -1;
+            }
+        }
+#endif
+        else
+        {
+            have = readArchive(data, qMin(maxlen, m_inLeft));
+            if (have < 0)
+                setErrorString("error reading device");
+            if (have <= 0 || m_inLeft == 0)
+                m_end = true;
+        }
+
+        if (have > 0)
+        {
+            m_out += have;
+            if (m_collect)
+                m_data.append(data, static_cast<int>(have));
+        }
+
+        //Put whole file to cache.
+        if (m_end && m_collect && m_out == m_header.uncompressedSize())
+            m_cache->insert(m_key, m_data);
+
+        return have;
+    }
+
+    return -1;
+}
+
+qint64 ZipEntryDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(len)
+    return -1;
+}
+
+qint64 ZipEntryDevice::readArchive(char *data, qint64 maxlen)
+{
+    //Archive may be shared, position is kept by entry.
+    if (m_archive->pos() != m_in && !m_archive->seek(m_in))
+        return -1;
+
+    const qint64 avail = m_archive->read(data, maxlen);
+    if (avail > 0)
+    {
+        m_in += avail;
+        m_inLeft -= avail;
+    }
+
+    return avail;
+}
+
+int ZipEntryDevice::inf(unsigned char *data, qint64 length, qint64 &have)
+{
+    int ret = Z_OK;
+    have = 0;
+
+    //Potential truncation!
+    m_strm.avail_out = static_cast<decltype(m_strm.avail_out)>(length);
+    m_strm.next_out = data;
+
+    do
+    {
+        if (m_strm.avail_in <= 0)
+        {
+            qint64 avail = readArchive(reinterpret_cast<char*>(m_buffer.data()),
+                                       qMin<qint64>(CHUNK, m_inLeft));
+            if (avail < 0)
+            {
+                ret = Z_ERRNO;
+                have = -1;
+                setErrorString("error reading device");
+                break;
+            }
+
+            if (avail == 0)
+            {
+                ret = Z_DATA_ERROR;
+                setErrorString("invalid end of compressed stream");
+                break;
+            }
+
+            //Potential truncation!
+            m_strm.avail_in = static_cast<decltype(m_strm.avail_in)>(avail);
+            m_strm.next_in = m_buffer.data();
+        }
+
+        ret = inflate(&m_strm, Z_NO_FLUSH);
+        Q_ASSERT(ret != Z_STREAM_ERROR);
+        switch (ret)
+        {
+        case Z_BUF_ERROR:
+            ret = Z_OK;
+            return ret;
+        case Z_NEED_DICT:
+            ret = Z_DATA_ERROR;
+        [[clang::fallthrough]];
+        case Z_DATA_ERROR:
+        case Z_MEM_ERROR:
+            have = -1;
+            setErrorString(m_strm.msg);
+            return ret;
+        }
+
+        have = length - m_strm.avail_out;
+    }
+    while (m_strm.avail_out != 0 && ret != Z_STREAM_END);
+
+    return ret;
+}
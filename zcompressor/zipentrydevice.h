@@ -0,0 +1,155 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ZIPENTRYDEVICE_H
+#define ZIPENTRYDEVICE_H
+
+#include "zipheader.h"
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <zlib.h>
+
+class ZstdCompressor;
+
+//Size-bounded LRU cache of decompressed zip files, may be shared by several threads.
+class ZipEntryCache
+{
+public:
+    //Max size in bytes of decompressed data.
+    explicit ZipEntryCache(int maxSize = 64 * 1024 * 1024)
+        : m_cache(maxSize)
+    {
+
+    }
+
+    //Key of file in archive.
+    static QString key(QIODevice *archive, const ZipHeader &header);
+
+    bool find(const QString &key, QByteArray &data);
+    void insert(const QString &key, const QByteArray &data);
+    void clear();
+
+    void setMaxSize(int size);
+    int maxSize() const;
+    int size() const;
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    mutable QMutex m_mutex;
+    QCache<QString, QByteArray> m_cache;
+    quint64 m_hits{0};
+    quint64 m_misses{0};
+};
+
+//Reads file from zip archive, decompresses on demand. Archive device may be shared by several
+//ZipEntryDevice objects of one thread.
+class ZipEntryDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    ZipEntryDevice(QIODevice *archive, const ZipHeader &header, ZipEntryCache *cache = nullptr,
+                   QObject *parent = nullptr)
+        : QIODevice(parent), m_archive(archive), m_header(header), m_cache(cache)
+    {
+
+    }
+
+    ~ZipEntryDevice() override
+    {
+        close();
+    }
+
+    // QIODevice interface
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    bool atEnd() const override
+    {
+        return m_end && QIODevice::atEnd();
+    }
+
+    qint64 size() const override
+    {
+        return m_header.uncompressedSize();
+    }
+
+    qint64 bytesAvailable() const override
+    {
+        if (isOpen())
+            return QIODevice::bytesAvailable() + m_header.uncompressedSize() - m_out;
+
+        return 0;
+    }
+
+    const ZipHeader& header() const noexcept
+    {
+        return m_header;
+    }
+
+    //True if decompressed data taken from cache.
+    bool isCached() const noexcept
+    {
+        return m_cached;
+    }
+
+protected:
+    // QIODevice interface
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    constexpr static unsigned CHUNK{16384};
+
+    qint64 readArchive(char *data, qint64 maxlen);
+    int inf(unsigned char *data, qint64 length, qint64 &have);
+
+    QIODevice *m_archive;
+    ZipHeader m_header;
+    ZipEntryCache *m_cache;
+    QString m_key;
+
+    z_stream m_strm;
+    bool m_inflate{false};
+    //Zstd decompressor (method 93) and compressed bytes of entry it reads.
+    ZstdCompressor *m_zstd{nullptr};
+    QIODevice *m_range{nullptr};
+    bool m_end{false};
+    bool m_cached{false};
+    bool m_collect{false};
+    //Position of next compressed byte in archive and bytes left.
+    qint64 m_in{0};
+    qint64 m_inLeft{0};
+    //Decompressed bytes.
+    qint64 m_out{0};
+    //Decompressed data, from cache or collected for cache.
+    QByteArray m_data;
+
+    QScopedPointer<unsigned char, QScopedPointerPodDeleter> m_buffer;
+};
+
+#endif // ZIPENTRYDEVICE_H
@@ -45,9 +45,12 @@ public:
     quint32 offset{0};
     quint16 time{0};
     quint16 date{0};
+    quint16 method{8};
+    quint16 flags{0};
     quint32 crc32{0};
     quint32 cSize{0};
     quint32 uSize{0};
+    QByteArray record;
 };
 
 ZipHeader::ZipHeader()
@@ -104,7 +107,7 @@ void ZipHeader::setName(const QString &name)
     m_data->name = name.toUtf8();
 }
 
-QByteArray ZipHeader::name() const noexcept
+const QByteArray& ZipHeader::name() const noexcept
 {
     return m_data->name;
 }
@@ -124,6 +127,11 @@ void ZipHeader::setTime(const QTime &time)
     m_data->time |= time.hour() << 11;
 }
 
+void ZipHeader::setTime(quint16 time) noexcept
+{
+    m_data->time = time;
+}
+
 quint16 ZipHeader::time() const noexcept
 {
     return m_data->time;
@@ -139,11 +147,41 @@ void ZipHeader::setDate(const QDate &date)
     m_data->date |= (date.year() - 1980) << 9;
 }
 
+void ZipHeader::setDate(quint16 date) noexcept
+{
+    m_data->date = date;
+}
+
 quint16 ZipHeader::date() const noexcept
 {
     return m_data->date;
 }
 
+void ZipHeader::setCompressionMethod(quint16 method) noexcept
+{
+    m_data->method = method;
+}
+
+quint16 ZipHeader::compressionMethod() const noexcept
+{
+    return m_data->method;
+}
+
+quint16 ZipHeader::versionNeeded() const noexcept
+{
+    return m_data->method == 93 ? 63 : 20;
+}
+
+void ZipHeader::setFlags(quint16 flags) noexcept
+{
+    m_data->flags = flags;
+}
+
+quint16 ZipHeader::flags() const noexcept
+{
+    return m_data->flags;
+}
+
 void ZipHeader::setOffset(quint32 offset) noexcept
 {
     m_data->offset = offset;
@@ -183,3 +221,13 @@ quint32 ZipHeader::uncompressedSize() const noexcept
 {
     return m_data->uSize;
 }
+
+void ZipHeader::setCentralRecord(const QByteArray &record)
+{
+    m_data->record = record;
+}
+
+const QByteArray& ZipHeader::centralRecord() const noexcept
+{
+    return m_data->record;
+}
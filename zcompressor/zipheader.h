@@ -39,15 +39,30 @@ public:
 
     //Name size limit is quint16 max value.
     void setName(const QString &name);
-    QByteArray name() const noexcept;
+    //UTF-8 name, reference is valid while header isn't changed.
+    const QByteArray& name() const noexcept;
     quint16 nameSize() const noexcept;
 
     void setTime(const QTime &time);
+    //Time in MS-DOS format (as stored in zip headers).
+    void setTime(quint16 time) noexcept;
     quint16 time() const noexcept;
 
     void setDate(const QDate &date);
+    //Date in MS-DOS format (as stored in zip headers).
+    void setDate(quint16 date) noexcept;
     quint16 date() const noexcept;
 
+    //Compression method, 8 - deflate by default, 93 - zstd.
+    void setCompressionMethod(quint16 method) noexcept;
+    quint16 compressionMethod() const noexcept;
+    //Version needed to extract for compression method (2.0 for deflate, 6.3 for zstd).
+    quint16 versionNeeded() const noexcept;
+
+    //General purpose flags, bit 3 - sizes and CRC32 are in data descriptor after file data.
+    void setFlags(quint16 flags) noexcept;
+    quint16 flags() const noexcept;
+
     void setOffset(quint32 offset) noexcept;
     quint32 offset() const noexcept;
 
@@ -60,6 +75,11 @@ public:
     void setUncompressedSize(quint32 size) noexcept;
     quint32 uncompressedSize() const noexcept;
 
+    //Raw central directory record of file of existing archive (with flags, extra field, comment
+    //and attributes), written back unchanged when archive is appended. Empty for new files.
+    void setCentralRecord(const QByteArray &record);
+    const QByteArray& centralRecord() const noexcept;
+
 private:
     QSharedDataPointer<ZipHeaderData> m_data;
 };
@@ -0,0 +1,297 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "zipreader.h"
+#include "zcompressor.h"
+#include "zstdcompressor.h"
+#include "crc32simd.h"
+
+#include <QDataStream>
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QThreadPool>
+#include <QRunnable>
+
+class ZipReaderTask : public QRunnable
+{
+public:
+    ZipReaderTask(ZipReader *reader, const ZipHeader &header, const QString &path, bool write)
+        : m_reader(reader), m_header(header), m_path(path), m_write(write)
+    {
+
+    }
+
+    void run() override
+    {
+        if (!m_reader->readFile(m_header, m_path, m_write))
+            m_reader->appendFailed(m_header);
+    }
+
+private:
+    ZipReader *m_reader;
+    ZipHeader m_header;
+    QString m_path;
+    bool m_write;
+};
+
+bool ZipReader::readEndArchive()
+{
+    m_headers.clear();
+    m_cdOffset = 0;
+
+    QIODevice *dev = m_device;
+    if (!dev || dev->isSequential() || !dev->isReadable())
+        return false;
+
+    //End of central directory record is 22 bytes plus comment up to 0xffff bytes.
+    const qint64 size = dev->size();
+    const qint64 tailSize = qMin<qint64>(size, 22 + 0xffff);
+    if (tailSize < 22 || !dev->seek(size - tailSize))
+        return false;
+
+    const QByteArray tail = dev->read(tailSize);
+    if (tail.size() != tailSize)
+        return false;
+
+    int eocd = tail.size() - 22;
+    for (; eocd >= 0; --eocd)
+    {
+        if (tail.at(eocd) == 0x50 && tail.at(eocd + 1) == 0x4b && tail.at(eocd + 2) == 0x05
+                && tail.at(eocd + 3) == 0x06)
+            break;
+    }
+
+    if (eocd < 0)
+        return false;
+
+    QDataStream eocdStrm(tail.mid(eocd, 22));
+    eocdStrm.setByteOrder(QDataStream::LittleEndian);
+    quint32 signature, cdSize, cdOffset;
+    quint16 disk, cdDisk, diskEntries, entries;
+    eocdStrm >> signature >> disk >> cdDisk >> diskEntries >> entries >> cdSize >> cdOffset;
+    //Multi-disk archives not supported.
+    if (disk != 0 || cdDisk != 0 || diskEntries != entries)
+        return false;
+
+    if (static_cast<qint64>(cdOffset) + cdSize > size - tailSize + eocd || !dev->seek(cdOffset))
+        return false;
+
+    const QByteArray cd = dev->read(cdSize);
+    if (cd.size() != static_cast<int>(cdSize))
+        return false;
+
+    QDataStream cdStrm(cd);
+    cdStrm.setByteOrder(QDataStream::LittleEndian);
+    QList<ZipHeader> headers;
+    int recordPos = 0;
+    for (quint16 i = 0; i < entries; ++i)
+    {
+        quint32 crc, cSize, uSize, extAttr, offset;
+        quint16 madeVersion, version, flags, method, time, date, nameSize, extraSize, commentSize,
+                diskStart, intAttr;
+        cdStrm >> signature >> madeVersion >> version >> flags >> method >> time >> date >> crc
+               >> cSize >> uSize >> nameSize >> extraSize >> commentSize >> diskStart >> intAttr
+               >> extAttr >> offset;
+        if (cdStrm.status() != QDataStream::Ok || signature != 0x02014b50)
+            return false;
+
+        QByteArray name(nameSize, Qt::Uninitialized);
+        if (cdStrm.readRawData(name.data(), nameSize) != nameSize
+                || cdStrm.skipRawData(extraSize + commentSize) != extraSize + commentSize)
+            return false;
+
+        ZipHeader header(QString::fromUtf8(name), offset, crc, cSize, uSize);
+        header.setTime(time);
+        header.setDate(date);
+        header.setCompressionMethod(method);
+        //Record is kept whole, fields not known to reader are not lost on append.
+        const int recordSize = 46 + nameSize + extraSize + commentSize;
+        header.setCentralRecord(cd.mid(recordPos, recordSize));
+        recordPos += recordSize;
+        headers.append(header);
+    }
+
+    m_headers = headers;
+    m_cdOffset = cdOffset;
+    return true;
+}
+
+bool ZipReader::extractAll(const QString &path, int threads)
+{
+    return run(path, true, threads);
+}
+
+bool ZipReader::verify(int threads)
+{
+    return run(QString(), false, threads);
+}
+
+//static.
+qint64 ZipReader::dataOffset(QIODevice *device, const ZipHeader &header)
+{
+    if (!device->seek(header.offset()))
+        return -1;
+
+    //Name and extra field of local header may differ from central directory.
+    const QByteArray local = device->read(30);
+    if (local.size() != 30 || local.at(0) != 0x50 || local.at(1) != 0x4b || local.at(2) != 0x03
+            || local.at(3) != 0x04)
+        return -1;
+
+    QDataStream strm(local.mid(26));
+    strm.setByteOrder(QDataStream::LittleEndian);
+    quint16 nameSize, extraSize;
+    strm >> nameSize >> extraSize;
+
+    return static_cast<qint64>(header.offset()) + 30 + nameSize + extraSize;
+}
+
+bool ZipReader::run(const QString &path, bool write, int threads)
+{
+    m_failed.clear();
+    if (m_headers.isEmpty() && !readEndArchive())
+        return false;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, threads));
+    for (const auto &header : m_headers)
+        pool.start(new ZipReaderTask(this, header, path, write));
+    pool.waitForDone();
+
+    return m_failed.isEmpty();
+}
+
+bool ZipReader::readFile(const ZipHeader &header, const QString &path, bool write)
+{
+    const QString name = QString::fromUtf8(header.name());
+    //Don't write outside of path.
+    const QString cleanName = QDir::cleanPath(name);
+    if (QDir::isAbsolutePath(cleanName) || cleanName == QLatin1String("..")
+            || cleanName.startsWith(QLatin1String("../")))
+        return false;
+
+    //Directory entry.
+    if (name.endsWith(QLatin1Char('/')))
+        return !write || QDir(path).mkpath(cleanName);
+
+    //Every thread reads own file if archive is a file, else compressed data copied under lock.
+    QFile file;
+    QBuffer buffer;
+    QIODevice *src = nullptr;
+    QFileDevice *archive = qobject_cast<QFileDevice*>(m_device);
+    if (archive && !archive->fileName().isEmpty())
+    {
+        file.setFileName(archive->fileName());
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        const qint64 offset = dataOffset(&file, header);
+        if (offset < 0 || !file.seek(offset))
+            return false;
+
+        src = &file;
+    }
+    else
+    {
+        QMutexLocker locker(&m_mutex);
+        const qint64 offset = dataOffset(m_device, header);
+        if (offset < 0 || !m_device->seek(offset))
+            return false;
+
+        buffer.setData(m_device->read(header.compressedSize()));
+        locker.unlock();
+
+        if (buffer.data().size() != static_cast<int>(header.compressedSize())
+                || !buffer.open(QIODevice::ReadOnly))
+            return false;
+
+        src = &buffer;
+    }
+
+    QScopedPointer<ZCompressor> inflater;
+#ifdef ZCOMPRESSOR_ZSTD
+    QScopedPointer<ZstdCompressor> zstd;
+#endif
+    QIODevice *in = src;
+    const bool stored = header.compressionMethod() == 0;
+    if (header.compressionMethod() == 8)
+    {
+        //Compression 8 - deflate.
+        inflater.reset(new ZCompressor(src));
+        inflater->setCompressFormat(ZCompressor::RawDeflateFormat);
+        if (!inflater->open(QIODevice::ReadOnly))
+            return false;
+
+        in = inflater.data();
+    }
+#ifdef ZCOMPRESSOR_ZSTD
+    else if (header.compressionMethod() == 93)
+    {
+        //Compression 93 - zstd.
+        zstd.reset(new ZstdCompressor(src));
+        if (!zstd->open(QIODevice::ReadOnly))
+            return false;
+
+        in = zstd.data();
+    }
+#endif
+    else if (!stored)
+        return false;
+
+    QFile out;
+    if (write)
+    {
+        const QString filePath = QDir(path).filePath(cleanName);
+        if (!QDir().mkpath(QFileInfo(filePath).absolutePath()))
+            return false;
+
+        out.setFileName(filePath);
+        if (!out.open(QIODevice::WriteOnly))
+            return false;
+    }
+
+    char data[16384];
+    quint32 crc = 0;
+    qint64 size = 0;
+    qint64 have;
+    while ((have = in->read(data, stored ? qMin<qint64>(sizeof(data), header.compressedSize() - size)
+                                         : static_cast<qint64>(sizeof(data)))) > 0)
+    {
+        crc = Crc32::update(crc, data, have);
+        size += have;
+        if (write && out.write(data, have) != have)
+            return false;
+    }
+
+    if (inflater && inflater->state() != Z_STREAM_END)
+        return false;
+
+#ifdef ZCOMPRESSOR_ZSTD
+    if (zstd && zstd->state() != Z_STREAM_END)
+        return false;
+#endif
+
+    return crc == header.crc32() && size == header.uncompressedSize();
+}
+
+void ZipReader::appendFailed(const ZipHeader &header)
+{
+    QMutexLocker locker(&m_mutex);
+    m_failed.append(QString::fromUtf8(header.name()));
+}
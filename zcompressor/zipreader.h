@@ -0,0 +1,101 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include "zipheader.h"
+
+#include <QObject>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+
+class QIODevice;
+
+class ZipReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    ZipReader() = default;
+
+    ZipReader(QIODevice *in)
+        : m_device(in)
+    {
+
+    }
+
+    ~ZipReader() = default;
+
+    //Reads central directory into headers.
+    bool readEndArchive();
+
+    //Decompresses files to directory path in threads, checks CRC32 and sizes of files.
+    bool extractAll(const QString &path, int threads = QThread::idealThreadCount());
+    //Decompresses files in threads and checks CRC32 and sizes, no output is written.
+    bool verify(int threads = QThread::idealThreadCount());
+
+    //Reads local header of file and returns offset of file data or -1 on error.
+    static qint64 dataOffset(QIODevice *device, const ZipHeader &header);
+
+    void setDevice(QIODevice *device)
+    {
+        m_device = device;
+        m_headers.clear();
+        m_cdOffset = 0;
+    }
+
+    QIODevice* device() const noexcept
+    {
+        return m_device;
+    }
+
+    const QList<ZipHeader>& headers() const noexcept
+    {
+        return m_headers;
+    }
+
+    quint32 centralDirectoryOffset() const noexcept
+    {
+        return m_cdOffset;
+    }
+
+    //Names of files failed by last extractAll or verify.
+    QStringList failedFiles() const
+    {
+        return m_failed;
+    }
+
+private:
+    friend class ZipReaderTask;
+
+    bool run(const QString &path, bool write, int threads);
+    bool readFile(const ZipHeader &header, const QString &path, bool write);
+    void appendFailed(const ZipHeader &header);
+
+    QIODevice *m_device{nullptr};
+    QList<ZipHeader> m_headers;
+    quint32 m_cdOffset{0};
+
+    //Guards shared device (if it can't be reopened in every thread) and failed list.
+    QMutex m_mutex;
+    QStringList m_failed;
+};
+
+#endif // ZIPREADER_H
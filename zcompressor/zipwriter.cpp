@@ -16,84 +16,236 @@
 */
 
 #include "zipwriter.h"
+#include "zipreader.h"
 #include "zcompressor.h"
+#include "filemapper.h"
+#include "zstdcompressor.h"
+#include "crc32simd.h"
 
 #include <QDataStream>
+#include <QtEndian>
+#include <QFileDevice>
+#include <QFile>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
 #include <QBuffer>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QDateTime>
+#include <QThread>
+
+//Compresses small file of directory to memory.
+class ZipWriterTask : public QRunnable
+{
+public:
+    ZipWriterTask(const QString &path, int level)
+        : m_path(path), m_level(level)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        QFile file(m_path);
+        if (file.open(QIODevice::ReadOnly))
+        {
+            FileMapper mapper(&file);
+            QByteArray bytes;
+            if (mapper.isValid() && mapper.next())
+                bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(mapper.data()),
+                                                static_cast<int>(mapper.size()));
+            else
+                bytes = file.readAll();
+
+            //Output fits in compress bound, buffer doesn't grow.
+            m_data.reserve(static_cast<int>(compressBound(static_cast<uLong>(bytes.size()))));
+            QBuffer buffer(&m_data);
+            buffer.open(QIODevice::WriteOnly);
+            m_crc = Crc32::update(0, bytes.constData(), bytes.size());
+            m_size = bytes.size();
+            m_ok = ZCompressor::def(bytes, &buffer, m_level, ZCompressor::RawDeflateFormat) == Z_OK;
+        }
+
+        m_done.release();
+    }
+
+    //Waits end of task.
+    void wait()
+    {
+        m_done.acquire();
+    }
+
+    const QByteArray& data() const noexcept
+    {
+        return m_data;
+    }
+
+    quint32 crc() const noexcept
+    {
+        return m_crc;
+    }
+
+    qint64 size() const noexcept
+    {
+        return m_size;
+    }
+
+    bool isOk() const noexcept
+    {
+        return m_ok;
+    }
+
+private:
+    QString m_path;
+    int m_level;
+    QByteArray m_data;
+    quint32 m_crc{0};
+    qint64 m_size{0};
+    bool m_ok{false};
+    QSemaphore m_done;
+};
+
+//File of directory, task is null for large files.
+struct ZipWriterEntry
+{
+    QString name;
+    QString path;
+    QDateTime modified;
+    ZipWriterTask *task;
+};
 
 void ZipWriter::appendLocalFileHeader(const ZipHeader &header)
 {
-    //Local file header.
+    //Local file header is built in place, so device gets one write for it and one for name.
+    uchar local[30];
     //Signature.
-    m_strm << qint8(0x50);
-    m_strm << qint8(0x4b);
-    m_strm << qint8(0x03);
-    m_strm << qint8(0x04);
+    qToLittleEndian<quint32>(0x04034b50, local);
 
     //Compress version.
-    m_strm << qint16(0x14);
+    qToLittleEndian<quint16>(header.versionNeeded(), local + 4);
     //Flags.
-    m_strm << qint16(0x0);
-    //Compression 8 - deflate.
-    m_strm << qint16(0x8);
+    qToLittleEndian<quint16>(header.flags(), local + 6);
+    //Compression method.
+    qToLittleEndian<quint16>(header.compressionMethod(), local + 8);
 
     //Modification time.
-    m_strm << header.time();
+    qToLittleEndian<quint16>(header.time(), local + 10);
     //Modification date.
-    m_strm << header.date();
+    qToLittleEndian<quint16>(header.date(), local + 12);
 
     //CRC32.
-    m_strm << header.crc32();
+    qToLittleEndian<quint32>(header.crc32(), local + 14);
 
     //Compressed length.
-    m_strm << header.compressedSize();
+    qToLittleEndian<quint32>(header.compressedSize(), local + 18);
     //Uncompressed length.
-    m_strm << header.uncompressedSize();
+    qToLittleEndian<quint32>(header.uncompressedSize(), local + 22);
     //File name length.
-    m_strm << header.nameSize();
+    qToLittleEndian<quint16>(header.nameSize(), local + 26);
     //Extra field length.
-    m_strm << qint16(0x0);
+    qToLittleEndian<quint16>(0, local + 28);
+    m_strm.writeRawData(reinterpret_cast<const char*>(local), sizeof(local));
+
     //File name.
     //Write only raw bytes (QDataStream::WriteRawData)!
-    const QByteArray fileNameBytes = header.name();
-    m_strm.writeRawData(fileNameBytes.data(), fileNameBytes.size());
+    const QByteArray &fileNameBytes = header.name();
+    m_strm.writeRawData(fileNameBytes.constData(), fileNameBytes.size());
 
+    m_offset += 30 + fileNameBytes.size();
     m_headers.append(header);
 }
 
+qint64 ZipWriter::offset() const
+{
+    QIODevice *dev = m_strm.device();
+    return dev->isSequential() ? m_offset : dev->pos();
+}
+
 bool ZipWriter::writeFile(const QString &name, const QByteArray &bytes)
 {
-    QByteArray comprBytes;
-    QBuffer buff(&comprBytes);
-    buff.open(QIODevice::WriteOnly);
-    if (ZCompressor::def(bytes, &buff, 8, ZCompressor::RawDeflateFormat) != Z_OK)
+    //Compressed directly to device after header, sizes and CRC are written by writeEndFile.
+    if (!writeStartFile(name))
         return false;
 
-    //Convert qint64 offset to quint32 (Zip header format, Zip64 will be later)!
-    ZipHeader header(name, static_cast<quint32>(m_strm.device()->pos()),
-                     crc32(0, reinterpret_cast<const unsigned char*>(bytes.data()),
-                           static_cast<quint32>(bytes.size())),
-                     0, static_cast<quint32>(bytes.size()));
-    header.setTime(QTime::currentTime());
-    header.setDate(QDate::currentDate());
-    header.setCompressedSize(static_cast<quint32>(comprBytes.size()));
-    appendLocalFileHeader(header);
-
-    //Compressed bytes.
-    m_strm.writeRawData(comprBytes.data(), comprBytes.size());
-    return true;
+    const bool ok = writeBytes(bytes);
+    return writeEndFile() && ok;
+}
+
+bool ZipWriter::writeFile(const QString &name, QIODevice *device)
+{
+    if (!writeStartFile(name))
+        return false;
+
+    const bool ok = writeDevice(device);
+    return writeEndFile() && ok;
+}
+
+bool ZipWriter::writeDevice(QIODevice *device)
+{
+    bool ok = true;
+    FileMapper mapper(device);
+    if (mapper.isValid())
+    {
+        while (ok)
+        {
+            ok = mapper.next();
+            if (!ok || mapper.size() == 0)
+                break;
+
+            //Window size is less than max of int.
+            ok = writeBytes(QByteArray::fromRawData(reinterpret_cast<const char*>(mapper.data()),
+                                                    static_cast<int>(mapper.size())));
+        }
+
+        mapper.seek(mapper.size());
+    }
+    else
+    {
+        while (ok)
+        {
+            const QByteArray bytes = device->read(1024 * 1024);
+            if (bytes.isEmpty())
+                break;
+
+            ok = writeBytes(bytes);
+        }
+    }
+
+    return ok;
 }
 
-bool ZipWriter::writeStartFile(const QString &name)
+bool ZipWriter::writeStartFile(const QString &name, const QDateTime &modified)
 {
-    m_cmprs.setDevice(m_strm.device());
-    if (m_cmprs.open(QIODevice::WriteOnly))
+    if (m_method == 93)
+    {
+#ifdef ZCOMPRESSOR_ZSTD
+        m_zstd.reset(new ZstdCompressor(m_strm.device()));
+        m_entry = m_zstd.data();
+#else
+        return false;
+#endif
+    }
+    else if (m_method == 8)
+    {
+        m_cmprs.setDevice(m_strm.device());
+        m_entry = &m_cmprs;
+    }
+    else
+        return false;
+
+    if (m_entry->open(QIODevice::WriteOnly))
     {
         //Convert qint64 offset to quint32 (Zip header format, Zip64 will be later)!
-        ZipHeader header(name, static_cast<quint32>(m_strm.device()->pos()));
-        header.setTime(QTime::currentTime());
-        header.setDate(QDate::currentDate());
+        ZipHeader header(name, static_cast<quint32>(offset()));
+        const QDateTime time = modified.isValid() ? modified : QDateTime::currentDateTime();
+        header.setTime(time.time());
+        header.setDate(time.date());
+        header.setCompressionMethod(m_method);
+        //Local header of sequential device can't be updated.
+        if (m_strm.device()->isSequential())
+            header.setFlags(0x8);
         appendLocalFileHeader(header);
 
         return true;
@@ -104,41 +256,171 @@ bool ZipWriter::writeStartFile(const QString &name)
 
 bool ZipWriter::writeBytes(const QByteArray &bytes)
 {
-    qint64 count = m_cmprs.write(bytes);
+    qint64 count = m_entry->write(bytes);
     if (count > 0)
     {   
         ZipHeader &header = m_headers[m_headers.size() - 1];
-        header.setCrc32(crc32(header.crc32(), reinterpret_cast<const unsigned char*>(bytes.data()),
-                              static_cast<quint32>(bytes.size())));
+        //Mapped windows are large enough for several threads.
+        header.setCrc32(Crc32::update(header.crc32(),
+                                      reinterpret_cast<const unsigned char*>(bytes.constData()),
+                                      bytes.size(), QThread::idealThreadCount()));
         header.setUncompressedSize(header.uncompressedSize() + static_cast<quint32>(bytes.size()));
     }
 
     return count != -1;
 }
 
-void ZipWriter::writeEndFile()
+bool ZipWriter::writeEndFile()
 {
-    m_cmprs.close();
+    m_entry->close();
+
+    //Compressed size is counted by compressor.
+    qint64 size = m_cmprs.totalOut();
+    bool ok = m_cmprs.state() == Z_STREAM_END;
+#ifdef ZCOMPRESSOR_ZSTD
+    if (m_entry == m_zstd.data())
+    {
+        const ZstdCompressor *zstd = static_cast<ZstdCompressor*>(m_entry);
+        size = zstd->totalOut();
+        ok = zstd->state() == Z_STREAM_END;
+    }
+#endif
 
     ZipHeader &header = m_headers[m_headers.size() - 1];
-    header.setCompressedSize(m_cmprs.totalOut());
+    header.setCompressedSize(static_cast<quint32>(size));
+    m_offset += size;
 
+    if (header.flags() & 0x8)
+    {
+        //Data descriptor in one write.
+        uchar descriptor[16];
+        qToLittleEndian<quint32>(0x08074b50, descriptor);
+        qToLittleEndian<quint32>(header.crc32(), descriptor + 4);
+        qToLittleEndian<quint32>(header.compressedSize(), descriptor + 8);
+        qToLittleEndian<quint32>(header.uncompressedSize(), descriptor + 12);
+        m_strm.writeRawData(reinterpret_cast<const char*>(descriptor), sizeof(descriptor));
+        m_offset += 16;
+
+        return ok && m_strm.status() == QDataStream::Ok;
+    }
+
+    //End of file data may be not end of device (old central directory when appending).
     QIODevice *dev = m_strm.device();
-    dev->seek(header.offset() + 14);
+    const qint64 end = dev->pos();
+    if (!dev->seek(header.offset() + 14))
+        return false;
 
     m_strm << header.crc32();
     m_strm << header.compressedSize();
     m_strm << header.uncompressedSize();
 
-    dev->seek(dev->size());
+    return dev->seek(end) && ok && m_strm.status() == QDataStream::Ok;
+}
+
+bool ZipWriter::addDirectory(const QString &path, const QStringList &nameFilters, int threads)
+{
+    const QDir dir(path);
+    if (!dir.exists())
+        return false;
+
+    //Archive may be written to the same directory.
+    const QFileDevice *archive = qobject_cast<QFileDevice*>(m_strm.device());
+    const QString archivePath = archive ? QFileInfo(archive->fileName()).absoluteFilePath()
+                                        : QString();
+
+    threads = qMax(1, threads);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    //Files are written in order, compressed small files wait in memory, so they are bounded.
+    const int maxPending = threads * 4;
+    QList<ZipWriterEntry> pending;
+    QDirIterator it(path, nameFilters, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    bool ok = true;
+    while (ok)
+    {
+        while (pending.size() < maxPending && it.hasNext())
+        {
+            it.next();
+            const QFileInfo info = it.fileInfo();
+            if (info.absoluteFilePath() == archivePath)
+                continue;
+
+            ZipWriterEntry entry{dir.relativeFilePath(info.filePath()), info.filePath(),
+                                 info.lastModified(), nullptr};
+            //Other methods are compressed by writer.
+            if (m_method == 8 && info.size() <= SMALL_FILE)
+            {
+                entry.task = new ZipWriterTask(entry.path, m_cmprs.compressLevel());
+                pool.start(entry.task);
+            }
+
+            pending.append(entry);
+        }
+
+        if (pending.isEmpty())
+            break;
+
+        const ZipWriterEntry entry = pending.takeFirst();
+        if (entry.task)
+        {
+            entry.task->wait();
+            ok = entry.task->isOk();
+            if (ok)
+            {
+                //Convert qint64 offset to quint32 (Zip header format, Zip64 will be later)!
+                const QByteArray &data = entry.task->data();
+                ZipHeader header(entry.name, static_cast<quint32>(offset()),
+                                 entry.task->crc(), static_cast<quint32>(data.size()),
+                                 static_cast<quint32>(entry.task->size()));
+                header.setTime(entry.modified.time());
+                header.setDate(entry.modified.date());
+                appendLocalFileHeader(header);
+                ok = m_strm.writeRawData(data.constData(), data.size()) == data.size();
+                m_offset += data.size();
+            }
+
+            delete entry.task;
+        }
+        else
+        {
+            QFile file(entry.path);
+            ok = file.open(QIODevice::ReadOnly) && writeStartFile(entry.name, entry.modified);
+            if (ok)
+            {
+                ok = writeDevice(&file);
+                ok = writeEndFile() && ok;
+            }
+        }
+    }
+
+    //Not written files after error.
+    pool.waitForDone();
+    for (const auto &entry : pending)
+        delete entry.task;
+
+    return ok;
 }
 
-void ZipWriter::writeEndArchive()
+bool ZipWriter::writeEndArchive()
 {
+    QIODevice *dev = m_strm.device();
+    //Convert qint64 offset to quint32 (Zip header format, Zip64 will be later)!
+    const quint32 cdOffset = static_cast<quint32>(offset());
+
     for (int i = 0, size = m_headers.size(); i < size; ++i)
     {
         const ZipHeader header = m_headers.at(i);
 
+        //Files of existing archive.
+        const QByteArray &record = header.centralRecord();
+        if (!record.isEmpty())
+        {
+            m_strm.writeRawData(record.constData(), record.size());
+            continue;
+        }
+
         //Central directory.
         //Signature.
         m_strm << qint8(0x50);
@@ -147,15 +429,15 @@ void ZipWriter::writeEndArchive()
         m_strm << qint8(0x02);
 
         //Conmpress version.
-        m_strm << qint16(0x14);
+        m_strm << header.versionNeeded();
         //Decompress version.
-        m_strm << qint16(0x14);
+        m_strm << header.versionNeeded();
 
         //Flags.
-        m_strm << qint16(0x0);
+        m_strm << header.flags();
 
-        //Compression 8 - deflate.
-        m_strm << qint16(0x8);
+        //Compression method.
+        m_strm << header.compressionMethod();
 
         //Modification time.
         m_strm << header.time();
@@ -185,8 +467,8 @@ void ZipWriter::writeEndArchive()
         //Offset of local header from start.
         m_strm << header.offset();
         //File name.
-        const QByteArray nameBytes = header.name();
-        m_strm.writeRawData(nameBytes.data(), nameBytes.size());
+        const QByteArray &nameBytes = header.name();
+        m_strm.writeRawData(nameBytes.constData(), nameBytes.size());
     }
 
     //End of central directory.
@@ -210,10 +492,35 @@ void ZipWriter::writeEndArchive()
     m_strm << centralDirectorySize();
 
     //Offset of central directory from start.
-    m_strm << centralDirectoryOffset();
+    m_strm << cdOffset;
 
     //Comment length.
     m_strm << qint16(0x0);
 
+    //Buffered data of file is written before its size is checked.
+    bool ok = m_strm.status() == QDataStream::Ok;
+    QFileDevice *file = qobject_cast<QFileDevice*>(dev);
+    if (file && !file->flush())
+        ok = false;
+
+    //Cut tail of old central directory if new archive is shorter.
+    if (ok && file && file->size() > file->pos())
+        ok = file->resize(file->pos());
+
     m_headers.clear();
+    return ok;
+}
+
+bool ZipWriter::readEndArchive()
+{
+    QIODevice *dev = m_strm.device();
+    if (!dev || !dev->isWritable())
+        return false;
+
+    ZipReader reader(dev);
+    if (!reader.readEndArchive())
+        return false;
+
+    m_headers = reader.headers();
+    return dev->seek(reader.centralDirectoryOffset());
 }
@@ -24,6 +24,10 @@
 #include <QObject>
 #include <QList>
 #include <QDataStream>
+#include <QScopedPointer>
+#include <QThread>
+#include <QStringList>
+#include <QDateTime>
 
 class QBuffer;
 class QByteArray;
@@ -51,15 +55,48 @@ public:
     ~ZipWriter() = default;
 
     bool writeFile(const QString &name, const QByteArray &bytes);
-    bool writeStartFile(const QString &name);
+    //Reads device to end, files are compressed directly from mapped memory.
+    bool writeFile(const QString &name, QIODevice *device);
+    //Modification time of file is current time if not valid.
+    bool writeStartFile(const QString &name, const QDateTime &modified = QDateTime());
     bool writeBytes(const QByteArray &bytes);
-    void writeEndFile();
-    void writeEndArchive();
+    //Sizes and CRC32 are written to local header, or to data descriptor after file data if device
+    //is sequential. False if device or compressor failed.
+    bool writeEndFile();
+    //Writes central directory. False if stream or device failed.
+    bool writeEndArchive();
+
+    //Writes all files of directory tree (matching name filters) with paths relative to directory
+    //and modification times of files. Small files are compressed in several threads (in-flight
+    //files are bounded), large files are compressed from mapped memory when their turn comes.
+    bool addDirectory(const QString &path, const QStringList &nameFilters = QStringList(),
+                      int threads = QThread::idealThreadCount());
+
+    //Files up to this size are compressed in threads of addDirectory.
+    constexpr static qint64 SMALL_FILE{4 * 1024 * 1024};
+
+    //Reads central directory of existing archive (device must be opened for read and write) and
+    //positions device on it. New files overwrite old central directory, writeEndArchive writes
+    //central directory for old and new files.
+    bool readEndArchive();
 
     void setDevice(QIODevice *device)
     {
         m_strm.setDevice(device);
         m_cmprs.close();
+        m_offset = 0;
+    }
+
+    //Compression method of next files: 8 - deflate (default), 93 - zstd (if library is built with
+    //ZCOMPRESSOR_ZSTD, otherwise writing files fails).
+    void setCompressionMethod(quint16 method) noexcept
+    {
+        m_method = method;
+    }
+
+    quint16 compressionMethod() const noexcept
+    {
+        return m_method;
     }
 
     QIODevice* device() const noexcept
@@ -69,28 +106,32 @@ public:
 
 private:
     void appendLocalFileHeader(const ZipHeader &header);
+    //Position of device, sequential device position is counted by writer.
+    qint64 offset() const;
+    //Writes device data to end to current file.
+    bool writeDevice(QIODevice *device);
 
     quint32 centralDirectorySize() const
     {
         quint32 result = 0;
         for (const auto &header : m_headers)
-            result += 46 + header.nameSize();
-
-        return result;
-    }
-
-    quint32 centralDirectoryOffset() const
-    {
-        quint32 result = 0;
-        for (const auto &header : m_headers)
-            result += 30 + header.nameSize() + header.compressedSize();
+        {
+            result += header.centralRecord().isEmpty() ? 46 + header.nameSize()
+                                                       : header.centralRecord().size();
+        }
 
         return result;
     }
 
     QDataStream m_strm;
     ZCompressor m_cmprs;
+    quint16 m_method{8};
+    //Zstd compressor of current file and compressor of current file (m_cmprs or m_zstd).
+    QScopedPointer<QIODevice> m_zstd;
+    QIODevice *m_entry{nullptr};
     QList<ZipHeader> m_headers;
+    //Bytes written to sequential device.
+    qint64 m_offset{0};
 };
 
 #endif // ZIPWRITER_H
@@ -0,0 +1,190 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "zstdcompressor.h"
+
+#ifdef ZCOMPRESSOR_ZSTD
+
+bool ZstdCompressor::open(QIODevice::OpenMode mode)
+{
+    if (!isOpen() && m_device && m_device->isOpen())
+    {
+        m_state = Z_OK;
+        m_end = false;
+        m_totalOut = 0;
+        m_in = ZSTD_inBuffer{nullptr, 0, 0};
+
+        if (mode & QIODevice::WriteOnly)
+        {
+            m_cstrm = ZSTD_createCStream();
+            if (!m_cstrm || ZSTD_isError(ZSTD_initCStream(m_cstrm, m_level)))
+                m_state = Z_STREAM_ERROR;
+            else
+                m_buffer.resize(static_cast<int>(ZSTD_CStreamOutSize()));
+        }
+        else if (mode & QIODevice::ReadOnly)
+        {
+            m_dstrm = ZSTD_createDStream();
+            if (!m_dstrm || ZSTD_isError(ZSTD_initDStream(m_dstrm)))
+                m_state = Z_STREAM_ERROR;
+            else
+                m_buffer.resize(static_cast<int>(ZSTD_DStreamInSize()));
+        }
+        else
+            m_state = Z_ERRNO;
+
+        if (m_state == Z_OK)
+            QIODevice::open(mode);
+        else
+            close();
+    }
+
+    return isOpen();
+}
+
+void ZstdCompressor::close()
+{
+    if (isOpen() && (openMode() & QIODevice::WriteOnly) && !m_end)
+    {
+        //End of frame.
+        size_t remaining;
+        do
+        {
+            ZSTD_outBuffer out{m_buffer.data(), static_cast<size_t>(m_buffer.size()), 0};
+            remaining = ZSTD_endStream(m_cstrm, &out);
+            if (ZSTD_isError(remaining))
+            {
+                m_state = Z_STREAM_ERROR;
+                break;
+            }
+
+            if (!write(out))
+                break;
+        }
+        while (remaining > 0);
+
+        if (m_state == Z_OK)
+            m_state = Z_STREAM_END;
+    }
+
+    QIODevice::close();
+    if (m_cstrm)
+    {
+        ZSTD_freeCStream(m_cstrm);
+        m_cstrm = nullptr;
+    }
+
+    if (m_dstrm)
+    {
+        ZSTD_freeDStream(m_dstrm);
+        m_dstrm = nullptr;
+    }
+}
+
+qint64 ZstdCompressor::writeData(const char *data, qint64 len)
+{
+    if (m_end)
+        return -1;
+
+    ZSTD_inBuffer in{data, static_cast<size_t>(len), 0};
+    while (in.pos < in.size)
+    {
+        ZSTD_outBuffer out{m_buffer.data(), static_cast<size_t>(m_buffer.size()), 0};
+        if (ZSTD_isError(ZSTD_compressStream(m_cstrm, &out, &in)))
+        {
+            m_state = Z_STREAM_ERROR;
+            m_end = true;
+            return -1;
+        }
+
+        if (!write(out))
+            return -1;
+    }
+
+    return len;
+}
+
+bool ZstdCompressor::write(ZSTD_outBuffer &out)
+{
+    const qint64 have = static_cast<qint64>(out.pos);
+    if (m_device->write(reinterpret_cast<const char*>(out.dst), have) != have)
+    {
+        m_state = Z_ERRNO;
+        m_end = true;
+        setErrorString("error writing device");
+        return false;
+    }
+
+    m_totalOut += have;
+    return true;
+}
+
+qint64 ZstdCompressor::readData(char *data, qint64 maxlen)
+{
+    if (m_end)
+        return -1;
+
+    ZSTD_outBuffer out{data, static_cast<size_t>(maxlen), 0};
+    while (out.pos < out.size && !m_end)
+    {
+        if (m_in.pos == m_in.size)
+        {
+            const qint64 avail = m_device->read(m_buffer.data(), m_buffer.size());
+            if (avail < 0)
+            {
+                m_state = Z_ERRNO;
+                m_end = true;
+                setErrorString("error reading device");
+                return -1;
+            }
+
+            if (avail == 0)
+            {
+                //Sequential device may have more data later.
+                if (!m_device->isSequential())
+                {
+                    m_state = Z_DATA_ERROR;
+                    m_end = true;
+                    setErrorString("invalid end of compressed frame");
+                }
+                break;
+            }
+
+            m_in = ZSTD_inBuffer{m_buffer.constData(), static_cast<size_t>(avail), 0};
+        }
+
+        const size_t ret = ZSTD_decompressStream(m_dstrm, &out, &m_in);
+        if (ZSTD_isError(ret))
+        {
+            m_state = Z_DATA_ERROR;
+            m_end = true;
+            setErrorString(ZSTD_getErrorName(ret));
+            return -1;
+        }
+
+        //Frame is decoded and flushed.
+        if (ret == 0)
+        {
+            m_state = Z_STREAM_END;
+            m_end = true;
+        }
+    }
+
+    return static_cast<qint64>(out.pos);
+}
+
+#endif // ZCOMPRESSOR_ZSTD
@@ -0,0 +1,103 @@
+/*
+    This file is part of ZCompressor.
+
+    ZCompressor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ZSTDCOMPRESSOR_H
+#define ZSTDCOMPRESSOR_H
+
+#ifdef ZCOMPRESSOR_ZSTD
+
+#include <QIODevice>
+#include <QByteArray>
+#include <zlib.h>
+#include <zstd.h>
+
+//Zstandard frame as QIODevice (zip method 93), compresses when write and decompresses when read
+//one frame. State is reported by zlib codes as ZCompressor.
+class ZstdCompressor : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit ZstdCompressor(QIODevice *device, QObject *parent = nullptr)
+        : QIODevice(parent), m_device(device)
+    {
+
+    }
+
+    ~ZstdCompressor() override
+    {
+        close();
+    }
+
+    // QIODevice interface
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    bool atEnd() const override
+    {
+        return m_end && QIODevice::atEnd();
+    }
+
+    void setCompressLevel(int level) noexcept
+    {
+        m_level = level;
+    }
+
+    int compressLevel() const noexcept
+    {
+        return m_level;
+    }
+
+    int state() const noexcept
+    {
+        return m_state;
+    }
+
+    //Compressed bytes written to device.
+    qint64 totalOut() const noexcept
+    {
+        return m_totalOut;
+    }
+
+protected:
+    // QIODevice interface
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    bool write(ZSTD_outBuffer &out);
+
+    QIODevice *m_device;
+    int m_level{ZSTD_CLEVEL_DEFAULT};
+    int m_state{Z_OK};
+    bool m_end{false};
+    qint64 m_totalOut{0};
+
+    ZSTD_CStream *m_cstrm{nullptr};
+    ZSTD_DStream *m_dstrm{nullptr};
+    QByteArray m_buffer;
+    ZSTD_inBuffer m_in{nullptr, 0, 0};
+};
+
+#endif // ZCOMPRESSOR_ZSTD
+
+#endif // ZSTDCOMPRESSOR_H